@@ -7,6 +7,8 @@
 //  This is a simple graphics engine to simulate visual effect of special relativity.
 //  OpenGL 4.1 is used to handle the graphics. Window is created with GLFW and GLAD libraries; GLM library is used in the vector calculations as it is compatible with OpenGL. In the simulation it is assumed that the other frames are moving at a constant velocities relative to the observer (the objects in those frame can perform any transformation). The effects of special relativity (Lorentz transformation and Doppler shift for light) and finite speed of propagation of light are taken into account. The physical theory is derived in the presentation - the code uses the same notation. To change the the scenario visible on the scene, modify "setUpScene" function in "scene.h".
 #define RETINA
+//#define SOLVER_TELEMETRY // colour the relativistic objects by the number of iterations of the solver per vertex (green - none, red - 40 or more)
+#define HALF_TEX_COORDS // send the texture coordinates of the models as half floats (precise enough for the textures up to about 2048 pixels, if the coordinates stay within [0, 1])
 //
 //
 //  The code was written with the help of the following tutorials and websites:
@@ -24,6 +26,11 @@
 //  2             to show/hide GUI
 //  3             to set the speed of propagation of light to infinity/back to normal - to show where the objects actually are at a given time
 //  4             to turn off/on doppler effect
+//  5             to turn on/off the warm start of the solver - reuse the times solved in the previous frame (see "warm_start.h")
+//  6             to turn on/off the tessellation of the edges which look curved (see "sr_ray.vs")
+//  7             to turn on/off the cache of the solved vertices - every vertex is solved once per frame into a buffer, which is then drawn (see "apparent_geometry.h")
+//
+//  Run the program with "--benchmark" argument to measure the performance of the culling on the CPU and of the solver on the GPU, and to check the shader against the CPU solver (see "benchmark.h").
 //
 //
 //  THIS PROGRAM HAS ONLY BEEN TESTED ON MAC OS 10.15.2
@@ -42,6 +49,7 @@
 #include "src/camera.h"
 #include "src/scene.h"
 #include "src/gui.h"
+#include "src/benchmark.h"
 
 #include <iostream>
 
@@ -51,7 +59,7 @@ void processInput(GLFWwindow*);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
-void updateGUI(float camera_time);
+void updateGUI(float camera_time, unsigned int drawn_objects, unsigned int culled_objects, size_t processed_vertices, size_t full_detail_vertices);
 
 // function that provides a fix for Mac OS 10.14+ initial black screen
 #ifdef __APPLE__
@@ -81,6 +89,15 @@ bool toggling_true_position = false;
 bool turn_off_doppler = false;
 bool toggling_doppler = false;
 
+bool warm_start = false;
+bool toggling_warm_start = false;
+
+bool tessellation = false;
+bool toggling_tessellation = false;
+
+bool apparent_cache = false;
+bool toggling_apparent_cache = false;
+
 // gui declaration and controls
 GUI gui(scr_width, scr_height);
 bool toggling_gui = false;
@@ -119,6 +136,26 @@ int main(int argc, const char * argv[]) {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    
+    // run the CPU benchmarks, then the GPU benchmark and the check of the solver of the shader against the CPU one in a hidden window
+    if(argc > 1 && std::string(argv[1]) == "--benchmark") {
+        Benchmark::run();
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        GLFWwindow* window = glfwCreateWindow(64, 64, "Special Relativity", NULL, NULL);
+        bool passed = false;
+        if(window == NULL) std::cout << "ERROR: Failed to create GLFW window, the shader is not benchmarked and checked" << std::endl;
+        else {
+            glfwMakeContextCurrent(window);
+            if(gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+                Benchmark::benchmarkInvariants();
+                passed = Benchmark::checkShader();
+            }
+            else std::cout << "ERROR: Failed to initialize GLAD" << std::endl;
+        }
+        glfwTerminate();
+        return passed ? 0 : -1;
+    }
+    
     glfwWindowHint(GLFW_SAMPLES, 4);
     
     // open GLFW window and make it the current context
@@ -149,53 +186,69 @@ int main(int argc, const char * argv[]) {
         return -1;
     }
     
-    // load the scene containing objects, test models and their shaders
-    Scene scene;
-    
-    // load a font to the GUI
-    gui.loadFont("assets/fonts/hack.ttf", 28);
-    
-    // optimise the program (turned off, as we want to see how some of the objects look from inside)
-    //glEnable(GL_CULL_FACE);
-    
-    glEnable(GL_DEPTH_TEST);
-    
-    // render loop
-    while(!glfwWindowShouldClose(window)) {
-        #ifdef __APPLE__
-        macWindowFix(window);
-        #endif
-        
-        float currentFrameTime = glfwGetTime();
-        delta_time = currentFrameTime - last_frame_time;
-        last_frame_time = currentFrameTime;
-        if(fps_steps_counter == fps_steps) {
-            gui.updateText(FPS, std::to_string(int(glm::round(1.0f/(fps_sum/float(fps_steps))))));
-            fps_steps_counter = 0;
-            fps_sum = 0;
-        }
-        fps_sum += delta_time;
-        fps_steps_counter++;
-        
-        processInput(window);
-        
-        glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // the scene and the models are deleted when the block ends, before the context is destroyed
+    {
+        // the models are kept by the registry, so the scene can be built again without loading them again
+        ModelRegistry model_registry;
         
-        updateGUI(scene.time);
+        // load the scene containing objects, test models and their shaders
+        Scene scene(model_registry);
         
-        if(!update_time) delta_time = 0.0f;
+        // load a font to the GUI
+        gui.loadFont("assets/fonts/hack.ttf", 28);
         
-        scene.draw(&camera, scr_ratio, delta_time * time_flow_speed, show_true_position, turn_off_doppler);
+        // optimise the program (turned off, as we want to see how some of the objects look from inside)
+        //glEnable(GL_CULL_FACE);
         
-        if(draw_coords) scene.drawPos(&camera, scr_ratio, show_true_position);
+        GLState::setEnabled(GL_DEPTH_TEST, true);
         
-        if(draw_gui) gui.draw();
-        
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // render loop
+        while(!glfwWindowShouldClose(window)) {
+            #ifdef __APPLE__
+            macWindowFix(window);
+            #endif
+            
+            float currentFrameTime = glfwGetTime();
+            delta_time = currentFrameTime - last_frame_time;
+            last_frame_time = currentFrameTime;
+            if(fps_steps_counter == fps_steps) {
+                gui.updateText(FPS, std::to_string(int(glm::round(1.0f/(fps_sum/float(fps_steps))))));
+                fps_steps_counter = 0;
+                fps_sum = 0;
+            }
+            fps_sum += delta_time;
+            fps_steps_counter++;
+            
+            processInput(window);
+            model_registry.update();
+            
+            glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            
+            updateGUI(scene.time, scene.drawnObjects(), scene.culledObjects(), scene.processedVertices(), scene.fullDetailVertices());
+            
+            if(!update_time) delta_time = 0.0f;
+            
+            scene.setScreenProjection(gui.getProjection());
+            scene.setViewport((float)scr_width, (float)scr_height);
+            scene.setTimeFlowSpeed(time_flow_speed);
+            if(warm_start != scene.isWarmStartOn()) scene.toggleWarmStart();
+            if(tessellation != scene.isTessellationOn()) scene.toggleTessellation();
+            if(apparent_cache != scene.isApparentCacheOn()) scene.toggleApparentCache();
+            scene.draw(&camera, scr_ratio, delta_time * time_flow_speed, show_true_position, turn_off_doppler);
+            
+            if(draw_coords) scene.drawPos(&camera, scr_ratio, show_true_position);
+            
+            if(draw_gui) gui.draw();
+            
+            GLState::endFrame();
+            
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }
     
+    gui.releaseShader();
     glfwTerminate();
     return 0;
 }
@@ -206,11 +259,15 @@ std::string vec3_to_string(const glm::vec3 v) {
     return ss.str();
 }
 
-void updateGUI(float camera_time) {
+void updateGUI(float camera_time, unsigned int drawn_objects, unsigned int culled_objects, size_t processed_vertices, size_t full_detail_vertices) {
     gui.updateText(CAMERA_POSITION, vec3_to_string(camera.position));
     gui.updateText(CAMERA_TIME, std::to_string(camera_time));
     gui.updateText(CAMERA_ORIENTATION, vec3_to_string(camera.getDirection()));
     gui.updateText(CAMERA_ANGLE, std::to_string(int(camera.getFov())));
+    gui.updateText(GL_CALLS, std::to_string(GLState::issuedCalls()) + " issued, " + std::to_string(GLState::elidedCalls()) + " skipped");
+    gui.updateText(TEXTURES, std::to_string(TextureRegistry::textureCount()) + " (" + std::to_string(TextureRegistry::usedBytes() / 1024) + " KB, " + std::to_string(TextureRegistry::savedBytes() / 1024) + " KB saved)");
+    gui.updateText(CULLING, std::to_string(drawn_objects) + " drawn, " + std::to_string(culled_objects) + " culled");
+    gui.updateText(VERTICES, std::to_string(processed_vertices) + " (" + std::to_string(full_detail_vertices) + " without LOD)");
 }
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
@@ -265,6 +322,24 @@ void processInput(GLFWwindow* window) {
     } else if(glfwGetKey(window, GLFW_KEY_4) == GLFW_RELEASE)
         toggling_doppler = false;
     
+    if(glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS) {
+        if(!toggling_warm_start) warm_start = !warm_start;
+        toggling_warm_start = true;
+    } else if(glfwGetKey(window, GLFW_KEY_5) == GLFW_RELEASE)
+        toggling_warm_start = false;
+    
+    if(glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS) {
+        if(!toggling_tessellation) tessellation = !tessellation;
+        toggling_tessellation = true;
+    } else if(glfwGetKey(window, GLFW_KEY_6) == GLFW_RELEASE)
+        toggling_tessellation = false;
+    
+    if(glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS) {
+        if(!toggling_apparent_cache) apparent_cache = !apparent_cache;
+        toggling_apparent_cache = true;
+    } else if(glfwGetKey(window, GLFW_KEY_7) == GLFW_RELEASE)
+        toggling_apparent_cache = false;
+
     if(glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS) {
         if(!taking_screenshot) camera.takeScreenshot(scr_width, scr_height);
         taking_screenshot = true;
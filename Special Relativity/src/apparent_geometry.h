@@ -0,0 +1,166 @@
+//
+//  apparent_geometry.h
+//  Special Relativity
+//
+//  Keeps the vertices of the objects of one instance group solved in the current frame, so a pass which draws the group (see "Scene::drawApparent") reads them instead of solving the light cone equation again - the cost of the solver does not grow with the number of the passes. Every vertex is solved once per instance, also the vertices which would miss the post-transform cache.
+//  Every vertex of every drawn instance is written once by the CAPTURE_APPARENT variant of "sr_ray.vs" with transform feedback, as two vec4: the apparent position (IN S FRAME, relative to the camera) and the texture coordinates with the number of iterations of the solver. The passes read the instance attributes as well, so the Doppler shift is calculated per fragment like without the cache. The passes read them in "sr_apparent.vs" from a buffer texture (OpenGL 4.1 has no storage buffers), the vertices of instance "i" start at "i * number of the vertices of the level".
+//  Only the vertices used by the level of detail of an instance are solved - the meshes list the vertices of every level once (see "Mesh::preparePointLevels").
+//
+//  *** "fits(model, level_first)":
+//  - false if the vertices of the instances do not fit in a buffer texture (GL_MAX_TEXTURE_BUFFER_SIZE) - then the group has to be drawn without the cache.
+//
+//  *** "solve(model, instances, level_first)":
+//  - solves the instances of the buffer, sorted by their levels of detail ("level_first" - the first instance of every level, the number of the instances at the end, see "Scene::updateVisibleInstances"). The CAPTURE_APPARENT shader has to be in use, with GL_RASTERIZER_DISCARD enabled.
+//
+//  *** "draw(model, instances, shader)":
+//  - draws the instances solved last (the same "instances" as given to "solve") with a shader made of "sr_apparent.vs".
+//
+
+#ifndef apparent_geometry_h
+#define apparent_geometry_h
+
+#include <glad/glad.h>
+#include "glm.hpp"
+
+#include "model.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "instance_buffer.h"
+
+#include <vector>
+#include <algorithm>
+
+// the texture unit of the solved vertices, after the textures of the meshes
+const unsigned int APPARENT_GEOMETRY_TEXTURE_UNIT = 15;
+// vec4 texels written for every vertex
+const unsigned int APPARENT_GEOMETRY_TEXELS = 2;
+
+class ApparentGeometry {
+private:
+    // the solved vertices of one mesh of the model
+    struct Capture {
+        unsigned int buffer = 0, texture = 0;
+        size_t capacity = 0; // in vertices
+        std::vector<size_t> level_vertex; // the first vertex of every level
+    };
+
+    std::vector<Capture> captures;
+    std::vector<unsigned int> level_first; // of the last "solve"
+
+    static size_t maxVertices() {
+        static int texels = -1;
+        if(texels < 0) {
+            texels = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+        }
+        return (size_t)texels / APPARENT_GEOMETRY_TEXELS;
+    }
+
+    static size_t vertexCount(const Mesh& mesh, const std::vector<unsigned int>& level_first) {
+        size_t vertices = 0;
+        for(unsigned int level = 0; level + 1 < level_first.size(); level++) vertices += (size_t)(level_first[level + 1] - level_first[level]) * mesh.pointLevel(level).point_count;
+        return vertices;
+    }
+
+    // the buffer grows twice, so it is not allocated again when a few more objects come into view
+    void reserve(Capture& capture, size_t vertices) {
+        if(vertices <= capture.capacity) return;
+        capture.capacity = std::min(std::max(vertices, 2 * capture.capacity), maxVertices());
+        if(!capture.buffer) {
+            glGenBuffers(1, &capture.buffer);
+            glGenTextures(1, &capture.texture);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, capture.buffer);
+        glBufferData(GL_TEXTURE_BUFFER, capture.capacity * APPARENT_GEOMETRY_TEXELS * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        GLState::bindBufferTexture(APPARENT_GEOMETRY_TEXTURE_UNIT, capture.texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, capture.buffer);
+    }
+
+    void release() {
+        for(Capture& capture : captures) {
+            if(capture.buffer) glDeleteBuffers(1, &capture.buffer);
+            if(capture.texture) glDeleteTextures(1, &capture.texture);
+        }
+        captures.clear();
+    }
+
+public:
+    ApparentGeometry() {}
+
+    // the buffers belong to the OpenGL context, so the object can only be moved
+    ApparentGeometry(const ApparentGeometry&) = delete;
+    ApparentGeometry& operator=(const ApparentGeometry&) = delete;
+
+    ApparentGeometry(ApparentGeometry&& other) noexcept : captures(std::move(other.captures)), level_first(std::move(other.level_first)) {
+        other.captures.clear();
+    }
+
+    ApparentGeometry& operator=(ApparentGeometry&& other) noexcept {
+        if(this != &other) {
+            release();
+            captures = std::move(other.captures);
+            level_first = std::move(other.level_first);
+            other.captures.clear();
+        }
+        return *this;
+    }
+
+    ~ApparentGeometry() {
+        release();
+    }
+
+    bool fits(Model& model, const std::vector<unsigned int>& level_first) const {
+        for(Mesh& mesh : model.meshes) {
+            mesh.preparePointLevels();
+            if(vertexCount(mesh, level_first) > maxVertices()) return false;
+        }
+        return true;
+    }
+
+    void solve(Model& model, const InstanceBuffer& instances, const std::vector<unsigned int>& level_first) {
+        this->level_first = level_first;
+        captures.resize(model.meshes.size());
+        for(unsigned int i = 0; i < model.meshes.size(); i++) {
+            Mesh& mesh = model.meshes[i];
+            mesh.preparePointLevels();
+            Capture& capture = captures[i];
+            capture.level_vertex.assign(1, 0);
+            for(unsigned int level = 0; level + 1 < level_first.size(); level++) capture.level_vertex.push_back(capture.level_vertex.back() + (size_t)(level_first[level + 1] - level_first[level]) * mesh.pointLevel(level).point_count);
+            if(capture.level_vertex.back() == 0) continue;
+            reserve(capture, capture.level_vertex.back());
+
+            for(unsigned int level = 0; level + 1 < level_first.size(); level++) {
+                unsigned int count = level_first[level + 1] - level_first[level];
+                if(count == 0) continue;
+                size_t bytes = APPARENT_GEOMETRY_TEXELS * sizeof(glm::vec4);
+                instances.bindInstances(mesh, level_first[level]);
+                glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, capture.buffer, capture.level_vertex[level] * bytes, (capture.level_vertex[level + 1] - capture.level_vertex[level]) * bytes);
+
+                glBeginTransformFeedback(GL_POINTS);
+                mesh.drawPointsInstanced(count, level);
+                glEndTransformFeedback();
+            }
+        }
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    }
+
+    void draw(Model& model, const InstanceBuffer& instances, const Shader& shader) const {
+        shader.setInt("apparent_geometry", APPARENT_GEOMETRY_TEXTURE_UNIT);
+        for(unsigned int i = 0; i < model.meshes.size() && i < captures.size(); i++) {
+            Mesh& mesh = model.meshes[i];
+            const Capture& capture = captures[i];
+            for(unsigned int level = 0; level + 1 < level_first.size(); level++) {
+                unsigned int count = level_first[level + 1] - level_first[level];
+                if(count == 0) continue;
+                instances.bindInstances(mesh, level_first[level]); // the velocity and gamma of the instances for the Doppler effect
+                GLState::bindBufferTexture(APPARENT_GEOMETRY_TEXTURE_UNIT, capture.texture);
+                shader.setInt("apparent_first", (int)(capture.level_vertex[level] * APPARENT_GEOMETRY_TEXELS));
+                shader.setInt("apparent_points", (int)mesh.pointLevel(level).point_count);
+                mesh.drawFromPointsInstanced(shader, count, level);
+            }
+        }
+    }
+};
+
+#endif /* apparent_geometry_h */
@@ -0,0 +1,297 @@
+//
+//  benchmark.h
+//  Special Relativity
+//
+//  Benchmarks of the hottest parts of the program. Start the program with the "--benchmark" argument to run them (only a hidden window is opened, for the benchmark of the shader and "checkShader"). Each benchmark prints the throughput before and after an optimisation and the largest difference between the results.
+//
+//  *** "benchmarkCulling(object_count)":
+//  - time of finding the visible objects in one frame by testing every object (before) and with the kinetic hierarchy (after, including its refits and rebuilds) - the objects fly in all directions through a cube around the camera.
+//
+//  *** "benchmarkInvariants(vertex_count)":
+//  - GPU time (GL_TIME_ELAPSED query) of solving the vertices of a rotating object with the INSTANCED "sr_ray.vs" when gamma and the Lorentz boost are calculated for every vertex (before, the PER_VERTEX_INVARIANTS variant) and when they are read from the instance attributes (after). The solved vertices are captured with transform feedback and the rasterizer is off, so only the vertex stage is measured. Needs a current OpenGL context.
+//
+//  *** "checkShader(vertex_count)":
+//  - regression check of "sr_solver.h" - solves the same vertices with the INSTANCED "sr_ray.vs" (captured with transform feedback) and with "SRSolver", for a static object (the iterative and the analytic solution) and a rotating one. Returns false if they differ by more than SR_SOLVER_TOLERANCE. Needs a current OpenGL context.
+//
+
+#ifndef benchmark_h
+#define benchmark_h
+
+#include "glm.hpp"
+
+#include "gtc/matrix_transform.hpp"
+
+#include "sr_solver.h"
+#include "frustum.h"
+#include "kinetic_bvh.h"
+#include "shader.h"
+#include "uniform_blocks.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+class Benchmark {
+private:
+    // vertices spread uniformly in a unit ball, like the vertices of a typical model
+    static std::vector<glm::vec3> randomVertices(size_t count) {
+        std::mt19937 generator(2019);
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+        std::vector<glm::vec3> vertices;
+        vertices.reserve(count);
+        while(vertices.size() < count) {
+            glm::vec3 vertex(distribution(generator), distribution(generator), distribution(generator));
+            if(glm::dot(vertex, vertex) <= 1.0f) vertices.push_back(vertex);
+        }
+        return vertices;
+    }
+
+    // rotating object - the same motion as in the scenario with the wheels, so the solver cannot use the analytic solution
+    struct RotatingPosition {
+        glm::vec3 a_pos;
+        inline glm::vec3 operator()(float t_local) const {
+            float c = std::cos(0.9f*t_local), s = std::sin(0.9f*t_local);
+            return glm::vec3(c*a_pos.x - s*a_pos.y, s*a_pos.x + c*a_pos.y, a_pos.z);
+        }
+    };
+
+    template<typename Function>
+    static double measureSeconds(const Function& function) {
+        auto start = std::chrono::high_resolution_clock::now();
+        function();
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count();
+    }
+
+    static void printThroughput(const char* name, size_t vertex_count, double before, double after, float deviation) {
+        std::printf("%s: %.2f Mvertices/s before, %.2f Mvertices/s after (x%.2f), max relative deviation %.2e\n", name, vertex_count/before*1e-6, vertex_count/after*1e-6, before/after, deviation);
+    }
+
+    // the motion of "RotatingPosition" as the custom code of "sr_ray.vs"
+    static constexpr const char* ROTATING_POS_LOCAL = "return vec3(cos(0.9f*t_local)*aPos.x - sin(0.9f*t_local)*aPos.y, sin(0.9f*t_local)*aPos.x + cos(0.9f*t_local)*aPos.y, aPos.z);";
+
+    // the inputs of the INSTANCED "sr_ray.vs" for one object seen by the camera - the vertices in a vertex array, the object in the instance attributes (every vertex gets the same values, they are not read from a buffer) and the camera in the frame uniforms, with a buffer for the captured outputs
+    class SolverInputs {
+    public:
+        unsigned int VAO = 0, VBO = 0, capture = 0;
+        size_t vertex_count;
+        UniformBuffer<FrameUniforms> frame_buffer;
+
+        SolverInputs(const std::vector<glm::vec3>& vertices, const SRSolver& solver, const glm::vec3& initial_pos, const glm::vec3& velocity, const glm::vec4& camera, float speed_of_light, float bounding_radius) : vertex_count(vertices.size()), frame_buffer(FRAME_UNIFORMS_BINDING) {
+            FrameUniforms frame = {};
+            frame.PV = glm::mat4(1.0f);
+            frame.screen_projection = glm::mat4(1.0f);
+            frame.camera = camera;
+            frame.speed_of_light = speed_of_light;
+            frame.c_2_inv = solver.getC2Inv();
+            frame.viewport = glm::vec2(1.0f);
+            frame_buffer.set(0, frame);
+            frame_buffer.upload();
+
+            glGenVertexArrays(1, &VAO);
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &capture);
+            GLState::bindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, capture);
+            glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, vertex_count * 2 * sizeof(glm::vec4), nullptr, GL_STREAM_READ);
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+
+            glVertexAttrib4f(6, initial_pos.x, initial_pos.y, initial_pos.z, bounding_radius);
+            glVertexAttrib4f(7, velocity.x, velocity.y, velocity.z, solver.getVelocitySq());
+            const glm::vec4 time_bracket = solver.timeBracket(bounding_radius);
+            glVertexAttrib4f(4, time_bracket.x, time_bracket.y, time_bracket.z, time_bracket.w);
+            const glm::mat4 custom(1.0f), boost = solver.boost();
+            for(int i = 0; i < 4; i++) {
+                glVertexAttrib4fv(8 + i, &custom[i][0]);
+                glVertexAttrib4fv(12 + i, &boost[i][0]);
+            }
+        }
+
+        SolverInputs(const SolverInputs&) = delete;
+        SolverInputs& operator=(const SolverInputs&) = delete;
+
+        ~SolverInputs() {
+            GLState::bindVertexArray(0);
+            GLState::forgetVertexArray(VAO);
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &capture);
+        }
+
+        // solve every vertex with the shader (compiled with CAPTURE_APPARENT) into the capture buffer
+        void solve(Shader& shader) {
+            shader.use();
+            GLState::bindVertexArray(VAO);
+            GLState::setEnabled(GL_RASTERIZER_DISCARD, true);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, capture);
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, 0, (GLsizei)vertex_count);
+            glEndTransformFeedback();
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+            GLState::setEnabled(GL_RASTERIZER_DISCARD, false);
+        }
+
+        // the shortest GPU time of a few solves, in seconds - the first solve is not measured, the driver may still be preparing the program
+        double measureSolve(Shader& shader, int repeats = 5) {
+            unsigned int query;
+            glGenQueries(1, &query);
+            solve(shader);
+            double best = -1.0;
+            for(int i = 0; i < repeats; i++) {
+                glBeginQuery(GL_TIME_ELAPSED, query);
+                solve(shader);
+                glEndQuery(GL_TIME_ELAPSED);
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                if(best < 0.0 || elapsed*1e-9 < best) best = elapsed*1e-9;
+            }
+            glDeleteQueries(1, &query);
+            return best;
+        }
+
+        // the solved vertices and surfaces, interleaved as in "solved_vertex" and "solved_surface"
+        std::vector<glm::vec4> captured() const {
+            std::vector<glm::vec4> result(vertex_count * 2);
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, capture);
+            glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, result.size() * sizeof(glm::vec4), result.data());
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+            return result;
+        }
+    };
+
+public:
+    static void benchmarkInvariants(size_t vertex_count = 1000000) {
+        std::vector<glm::vec3> vertices = randomVertices(vertex_count);
+
+        const glm::vec3 initial_pos(0.0f, 1.0f, -4.0f), velocity(0.9f, 0.0f, 0.0f);
+        const glm::vec4 camera(1.0f, 0.0f, 1.0f, 0.0f);
+        const float speed_of_light = 1.0f, bounding_radius = 1.0f;
+        SRSolver solver(initial_pos, velocity, camera, speed_of_light);
+        SolverInputs inputs(vertices, solver, initial_pos, velocity, camera, speed_of_light, bounding_radius);
+
+        Shader shader_before("src/shaders/ray/sr_ray.vs", "src/shaders/ray/sr_ray.fs", ROTATING_POS_LOCAL, nullptr, "#define INSTANCED\n#define CAPTURE_APPARENT\n#define PER_VERTEX_INVARIANTS\n", {"solved_vertex", "solved_surface"});
+        Shader shader_after("src/shaders/ray/sr_ray.vs", "src/shaders/ray/sr_ray.fs", ROTATING_POS_LOCAL, nullptr, "#define INSTANCED\n#define CAPTURE_APPARENT\n", {"solved_vertex", "solved_surface"});
+
+        double before = inputs.measureSolve(shader_before);
+        std::vector<glm::vec4> result_before = inputs.captured();
+        double after = inputs.measureSolve(shader_after);
+        std::vector<glm::vec4> result_after = inputs.captured();
+
+        float deviation = 0.0f;
+        for(size_t i = 0; i < vertex_count; i++) {
+            glm::vec3 position_before(result_before[2*i]), position_after(result_after[2*i]);
+            deviation = glm::max(deviation, glm::length(position_before - position_after)/glm::max(glm::length(position_before), 1.0f));
+        }
+
+        printThroughput("Per-object invariants (GPU)", vertex_count, before, after, deviation);
+    }
+
+    static void benchmarkCulling(size_t object_count) {
+        const float speed_of_light = 1.0f, time_step = 0.05f;
+        const int frame_count = 100;
+        const float side = 10.0f * std::cbrt((float)object_count); // the same density of the objects for every count
+
+        std::mt19937 generator(2019);
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+        std::vector<KineticBVH::Item> items(object_count);
+        for(KineticBVH::Item& item : items) {
+            item.position = glm::vec3(distribution(generator), distribution(generator), distribution(generator)) * (0.5f * side);
+            glm::vec3 direction(distribution(generator), distribution(generator), distribution(generator));
+            float speed = 0.95f * speed_of_light * 0.5f * (distribution(generator) + 1.0f);
+            item.velocity = glm::length(direction) > 0.0f ? glm::normalize(direction) * speed : glm::vec3(0.0f);
+            item.radius = 1.0f;
+        }
+
+        glm::vec3 camera_position(0.0f);
+        Frustum frustum(glm::perspective(glm::radians(45.0f), 16.0f/9.0f, 0.1f, 10000.0f) * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        std::vector<std::vector<unsigned int>> result_before(frame_count), result_after(frame_count);
+        double before = measureSeconds([&]() {
+            for(int frame = 0; frame < frame_count; frame++) {
+                float time = frame * time_step;
+                for(unsigned int j = 0; j < items.size(); j++) {
+                    if(KineticBVH::isVisible(frustum, items[j], camera_position, time, speed_of_light, false)) result_before[frame].push_back(j);
+                }
+            }
+        });
+
+        KineticBVH bvh;
+        size_t tested = 0;
+        double build = measureSeconds([&]() { bvh.build(items, 0.0f, speed_of_light); });
+        double after = measureSeconds([&]() {
+            for(int frame = 0; frame < frame_count; frame++) {
+                float time = frame * time_step;
+                bvh.update(time);
+                tested += bvh.query(frustum, camera_position, time, false, result_after[frame]);
+            }
+        });
+
+        size_t mismatches = 0, visible = 0;
+        for(int frame = 0; frame < frame_count; frame++) {
+            std::sort(result_after[frame].begin(), result_after[frame].end());
+            if(result_before[frame] != result_after[frame]) mismatches++;
+            visible += result_before[frame].size();
+        }
+
+        std::printf("Culling %zu objects: %.3f ms/frame linear scan, %.3f ms/frame kinetic BVH (x%.2f, build %.3f ms), %zu visible and %zu tested per frame, %zu frames with different results\n", object_count, before/frame_count*1e3, after/frame_count*1e3, before/after, build*1e3, visible/frame_count, tested/frame_count, mismatches);
+    }
+
+    static bool checkShader(size_t vertex_count = 10000) {
+        std::vector<glm::vec3> vertices = randomVertices(vertex_count);
+
+        const glm::vec3 initial_pos(0.0f, 1.0f, -4.0f), velocity(0.9f, 0.0f, 0.0f);
+        const glm::vec4 camera(1.0f, 0.0f, 1.0f, 0.0f);
+        const float speed_of_light = 1.0f, bounding_radius = 1.0f;
+        SRSolver solver(initial_pos, velocity, camera, speed_of_light);
+        solver.setTimeBracket(solver.timeBracket(bounding_radius));
+
+        SolverInputs inputs(vertices, solver, initial_pos, velocity, camera, speed_of_light, bounding_radius);
+
+        struct Case {
+            const char* name;
+            const char* custom_vertex_fragment;
+            std::string defines;
+        };
+        const Case cases[] = {
+            {"static object", nullptr, ""},
+            {"static object (analytic)", nullptr, "#define STATIC_LOCAL_SHAPE\n"},
+            {"rotating object", ROTATING_POS_LOCAL, ""}
+        };
+
+        bool passed = true;
+        for(const Case& check : cases) {
+            Shader shader("src/shaders/ray/sr_ray.vs", "src/shaders/ray/sr_ray.fs", check.custom_vertex_fragment, nullptr, check.defines + "#define INSTANCED\n#define CAPTURE_APPARENT\n", {"solved_vertex", "solved_surface"});
+            inputs.solve(shader);
+            std::vector<glm::vec4> captured = inputs.captured();
+
+            float deviation = 0.0f;
+            for(size_t i = 0; i < vertex_count; i++) {
+                glm::vec3 expected;
+                if(check.custom_vertex_fragment) expected = solver.apparentPosition(RotatingPosition{vertices[i]}, false);
+                else if(!check.defines.empty()) expected = solver.analyticPosition(vertices[i], false);
+                else expected = solver.apparentPosition(StaticPosition(vertices[i]), false);
+                glm::vec3 solved(captured[2*i]);
+                deviation = glm::max(deviation, glm::length(solved - expected)/glm::max(glm::length(expected), 1.0f));
+            }
+            bool case_passed = deviation <= SR_SOLVER_TOLERANCE;
+            passed = passed && case_passed;
+            std::printf("Shader check, %s: max relative deviation from SRSolver %.2e (tolerance %.0e) - %s\n", check.name, deviation, SR_SOLVER_TOLERANCE, case_passed ? "passed" : "FAILED");
+        }
+        return passed;
+    }
+
+    // the benchmarks on the CPU, "benchmarkInvariants" and "checkShader" need a window
+    static void run() {
+        for(size_t object_count : {1000, 10000, 100000}) benchmarkCulling(object_count);
+    }
+};
+
+#endif /* benchmark_h */
@@ -79,8 +79,9 @@ public:
         return fov;
     }
     
-    inline void transferData(Shader& shader) {
-        shader.setMat4("PV", projection*view);
+    // sent to the shaders in the FrameUniforms block
+    inline glm::mat4 getProjectionView() const {
+        return projection*view;
     }
     
     inline void move(CameraMovementDirection direction, float delta_time) {
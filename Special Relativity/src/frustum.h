@@ -0,0 +1,51 @@
+//
+//  frustum.h
+//  Special Relativity
+//
+//  The six planes of the view frustum of the camera, extracted from the projection * view matrix (Gribb, Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"). Used to skip the objects which cannot be seen before they are sent to the GPU.
+//
+//  *** "Frustum(PV)":
+//  - the frustum of the given projection * view matrix - the positions are in the same space as the positions multiplied by it in the shaders (relative to the camera).
+//
+//  *** "intersectsSphere(center, radius)", "intersectsBox(min, max)":
+//  - false only if the whole sphere (box) is outside of the frustum.
+//
+
+#ifndef frustum_h
+#define frustum_h
+
+#include "glm.hpp"
+
+struct Frustum {
+    glm::vec4 planes[6]; // xyz - normal pointing inside, w - distance, normalized
+
+    Frustum(const glm::mat4& PV) {
+        // rows of the matrix (glm stores the columns)
+        glm::vec4 rows[4];
+        for(int i = 0; i < 4; i++) rows[i] = glm::vec4(PV[0][i], PV[1][i], PV[2][i], PV[3][i]);
+
+        for(int i = 0; i < 3; i++) {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for(int i = 0; i < 6; i++) planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    inline bool intersectsSphere(const glm::vec3& center, float radius) const {
+        for(int i = 0; i < 6; i++) {
+            if(glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) return false;
+        }
+        return true;
+    }
+
+    // the box is outside if its corner furthest along the normal of a plane is outside
+    inline bool intersectsBox(const glm::vec3& min, const glm::vec3& max) const {
+        for(int i = 0; i < 6; i++) {
+            glm::vec3 corner(planes[i].x > 0.0f ? max.x : min.x, planes[i].y > 0.0f ? max.y : min.y, planes[i].z > 0.0f ? max.z : min.z);
+            if(glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f) return false;
+        }
+        return true;
+    }
+};
+
+#endif /* frustum_h */
@@ -0,0 +1,160 @@
+//
+//  gl_state.h
+//  Special Relativity
+//
+//  Remembers the state of OpenGL set through it (program, vertex array, textures, enabled capabilities, blending function) and skips the calls which would not change it. The integer uniforms which "Shader" skips setting again are counted here as well.
+//  All the code which changes the tracked state has to do it through this class - otherwise call "invalidate" afterwards, so the next calls are issued again.
+//
+//  *** "GLState::endFrame()":
+//  - called once per frame, stores the number of calls issued and skipped (elided) in the frame and resets the counters. Read them with "GLState::issuedCalls()" and "GLState::elidedCalls()".
+//
+
+#ifndef gl_state_h
+#define gl_state_h
+
+#include <glad/glad.h>
+
+#include <map>
+
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+
+class GLState {
+private:
+    struct State {
+        int program = -1; // -1 - unknown
+        int vertex_array = -1;
+        int active_texture = -1;
+        int textures[GL_STATE_TEXTURE_UNITS];
+        std::map<GLenum, int> capabilities;
+        GLenum blend_src = 0, blend_dst = 0;
+
+        unsigned int issued = 0, elided = 0;
+        unsigned int last_issued = 0, last_elided = 0;
+
+        State() {
+            for(unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) textures[i] = -1;
+        }
+    };
+
+    static State& state() {
+        static State gl_state;
+        return gl_state;
+    }
+
+    // true if the call has to be issued
+    static inline bool change(int& current, int value) {
+        if(current == value) {
+            state().elided++;
+            return false;
+        }
+        current = value;
+        state().issued++;
+        return true;
+    }
+
+public:
+    static void useProgram(unsigned int program) {
+        if(change(state().program, (int)program)) glUseProgram(program);
+    }
+
+    static void bindVertexArray(unsigned int vertex_array) {
+        if(change(state().vertex_array, (int)vertex_array)) glBindVertexArray(vertex_array);
+    }
+
+    static void activeTexture(unsigned int unit) {
+        if(change(state().active_texture, (int)unit)) glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // bind a 2D texture to the given texture unit
+    static void bindTexture(unsigned int unit, unsigned int texture) {
+        if(unit >= GL_STATE_TEXTURE_UNITS) {
+            activeTexture(unit);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            state().issued++;
+            return;
+        }
+        if(state().textures[unit] == (int)texture) {
+            state().elided++;
+            return;
+        }
+        activeTexture(unit);
+        change(state().textures[unit], (int)texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    // bind a buffer texture (GL_TEXTURE_BUFFER) to the given texture unit - not tracked, the 2D texture of the unit stays bound
+    static void bindBufferTexture(unsigned int unit, unsigned int texture) {
+        activeTexture(unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        state().issued++;
+    }
+
+    // glEnable/glDisable
+    static void setEnabled(GLenum capability, bool enabled) {
+        std::map<GLenum, int>::iterator it = state().capabilities.find(capability);
+        if(it == state().capabilities.end()) it = state().capabilities.insert(std::make_pair(capability, -1)).first;
+        if(!change(it->second, (int)enabled)) return;
+        if(enabled) glEnable(capability);
+        else glDisable(capability);
+    }
+
+    static void blendFunc(GLenum src, GLenum dst) {
+        if(state().blend_src == src && state().blend_dst == dst) {
+            state().elided++;
+            return;
+        }
+        state().blend_src = src;
+        state().blend_dst = dst;
+        state().issued++;
+        glBlendFunc(src, dst);
+    }
+
+    // count the calls which are not tracked here, but could be skipped (for example the integer uniforms remembered by "Shader")
+    static inline void countIssued() {
+        state().issued++;
+    }
+
+    static inline void countElided() {
+        state().elided++;
+    }
+
+    // the names of the deleted objects can be reused by OpenGL, so they cannot stay in the state
+    static void forgetProgram(unsigned int program) {
+        if(state().program == (int)program) state().program = -1;
+    }
+
+    static void forgetVertexArray(unsigned int vertex_array) {
+        if(state().vertex_array == (int)vertex_array) state().vertex_array = -1;
+    }
+
+    static void forgetTexture(unsigned int texture) {
+        for(unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) if(state().textures[i] == (int)texture) state().textures[i] = -1;
+    }
+
+    // forget the state, the next calls will be issued
+    static void invalidate() {
+        State& s = state();
+        s.program = s.vertex_array = s.active_texture = -1;
+        for(unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) s.textures[i] = -1;
+        s.capabilities.clear();
+        s.blend_src = s.blend_dst = 0;
+    }
+
+    static void endFrame() {
+        State& s = state();
+        s.last_issued = s.issued;
+        s.last_elided = s.elided;
+        s.issued = s.elided = 0;
+    }
+
+    // numbers of the calls in the last frame
+    static inline unsigned int issuedCalls() {
+        return state().last_issued;
+    }
+
+    static inline unsigned int elidedCalls() {
+        return state().last_elided;
+    }
+};
+
+#endif /* gl_state_h */
@@ -4,7 +4,7 @@
 //
 //  Created by Antoni Wójcik on 11/01/2020.
 //
-//  Creates a basic GUI displaying info about current FOV of the camera, current time, current orientation of the camera, current position of the camera and FPS.
+//  Creates a basic GUI displaying info about current FOV of the camera, current time, current orientation of the camera, current position of the camera, FPS, the number of OpenGL calls issued and skipped by "GLState" in the last frame, the memory of the textures shared by "TextureRegistry", the number of the objects drawn and culled and the number of the vertices drawn with and without the levels of detail.
 //
 
 #ifndef gui_h
@@ -12,6 +12,8 @@
 
 #include <string>
 
+#include "gl_state.h"
+
 // include FreeType libraries
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -21,7 +23,12 @@ enum TextOption {
     CAMERA_POSITION,
     CAMERA_ORIENTATION,
     CAMERA_TIME,
-    CAMERA_ANGLE
+    CAMERA_ANGLE,
+    GL_CALLS,
+    TEXTURES,
+    CULLING,
+    VERTICES,
+    TEXT_OPTION_COUNT
 };
 
 enum TextAlignment {
@@ -58,7 +65,7 @@ private:
     glm::mat4 projection;
     float scr_width;
     
-    DisplayedInfo info[5];
+    DisplayedInfo info[TEXT_OPTION_COUNT];
     
     /*void findTextWidth(DisplayedInfo& inf) {
         inf.length = float(characters[97].bearing.x + (characters[97].advance >> 6)) * (float(inf.text.length() + inf.variable.length())) * 2.0f;
@@ -75,6 +82,10 @@ private:
         //findTextWidth(info[CAMERA_TIME]);
         info[CAMERA_ANGLE] = DisplayedInfo("Angle", glm::vec2(20, 240), glm::vec3(0, 1, 0), LEFT_ALIGNMENT);
         //findTextWidth(info[CAMERA_ANGLE]);
+        info[GL_CALLS] = DisplayedInfo("GL calls", glm::vec2(20, 295), glm::vec3(0, 1, 0), LEFT_ALIGNMENT);
+        info[TEXTURES] = DisplayedInfo("Textures", glm::vec2(20, 350), glm::vec3(0, 1, 0), LEFT_ALIGNMENT);
+        info[CULLING] = DisplayedInfo("Objects", glm::vec2(20, 405), glm::vec3(0, 1, 0), LEFT_ALIGNMENT);
+        info[VERTICES] = DisplayedInfo("Vertices", glm::vec2(20, 460), glm::vec3(0, 1, 0), LEFT_ALIGNMENT);
     }
     
 public:
@@ -90,19 +101,17 @@ public:
     
     void draw() {
         glClear(GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GLState::setEnabled(GL_BLEND, true);
+        GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         
         font_shader.use();
         
-        for(int i = 0; i < 5; i++) {
+        for(int i = 0; i < TEXT_OPTION_COUNT; i++) {
             //if(info[i].alignment == LEFT_ALIGNMENT)
                 renderText(info[i].text + ": " + info[i].variable, info[i].position.x, info[i].position.y, 1.0f, info[i].color);
             /*else
                 renderText(info[i].text + ": " + info[i].variable, scr_width - info[i].length - info[i].position.x, info[i].position.y, 1.0f, info[i].color);*/
         }
-        
-        glDisable(GL_BLEND);
     }
     
     void loadFont(const char* font_path, int size) {
@@ -126,7 +135,7 @@ public:
             
             GLuint texture;
             glGenTextures(1, &texture);
-            glBindTexture(GL_TEXTURE_2D, texture);
+            GLState::bindTexture(0, texture);
             glTexImage2D(
                 GL_TEXTURE_2D,
                 0,
@@ -160,26 +169,22 @@ public:
         
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        GLState::bindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        GLState::bindVertexArray(0);
         
         font_shader = Shader("src/shaders/font/font.vs", "src/shaders/font/font.fs");
         
-        font_shader.use();
-        font_shader.setMat4("projection", projection);
-        
         setText();
     }
     
     void renderText(const std::string& text, GLfloat x, GLfloat y, GLfloat scale, const glm::vec3& text_color) {
         font_shader.setVec3("text_color", text_color);
-        glActiveTexture(GL_TEXTURE0);
-        glBindVertexArray(VAO);
+        GLState::bindVertexArray(VAO);
 
         std::string::const_iterator c;
         for (c = text.begin(); c != text.end(); c++) {
@@ -200,7 +205,7 @@ public:
                 { x_pos + w, y_pos,       1.0, 1.0 },
                 { x_pos + w, y_pos + h,   1.0, 0.0 }
             };
-            glBindTexture(GL_TEXTURE_2D, ch.texture_id);
+            GLState::bindTexture(0, ch.texture_id);
             glBindBuffer(GL_ARRAY_BUFFER, VBO);
             glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
             glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -209,15 +214,22 @@ public:
             
             x += (ch.advance >> 6) * scale;
         }
-        glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
     }
     
     void resize(float width, float height) {
         projection = glm::ortho(0.0f, width, 0.0f, height);
-        font_shader.setMat4("projection", projection);
         scr_width = width;
     }
+    
+    // sent to the shaders in the FrameUniforms block as "screen_projection"
+    inline const glm::mat4& getProjection() const {
+        return projection;
+    }
+    
+    // the GUI is global, so its shader would be deleted after the OpenGL context - call before "glfwTerminate"
+    void releaseShader() {
+        font_shader = Shader();
+    }
 };
 
 #endif /* gui_h */
@@ -0,0 +1,32 @@
+//
+//  hash.h
+//  Special Relativity
+//
+//  FNV-1a hash used by the caches to identify their sources ("mesh_cache.h", "program_cache.h"). A hash of a few pieces is made by passing the previous value as "value".
+//
+
+#ifndef hash_h
+#define hash_h
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+const std::uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+inline std::uint64_t fnv1a(const void* data, size_t size, std::uint64_t value = FNV_OFFSET_BASIS) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for(size_t i = 0; i < size; i++) {
+        value ^= bytes[i];
+        value *= 1099511628211ull;
+    }
+    return value;
+}
+
+inline std::uint64_t fnv1a(const std::string& text, std::uint64_t value = FNV_OFFSET_BASIS) {
+    // the length is hashed as well, so the pieces cannot be shifted between each other
+    std::uint64_t length = text.size();
+    return fnv1a(text.data(), text.size(), fnv1a(&length, sizeof(length), value));
+}
+
+#endif /* hash_h */
@@ -0,0 +1,154 @@
+//
+//  instance_buffer.h
+//  Special Relativity
+//
+//  Holds the data of all the objects which share one model and one relativistic shader, so they can be drawn with a single instanced draw call per mesh. The data is read by the INSTANCED variant of "sr_ray.vs" as per-instance attributes (locations 6-15), which replace the per-object uniforms. The invariants of the motion (the Lorentz boost, gamma and velocity^2) are calculated once per object on the CPU and sent with the rest of the data, so the shader does not calculate them again for every vertex. The time brackets (see "SRSolver::timeBracket") depend on the camera, so they are kept in a second buffer, written every frame (location 4 - "sr_ray.vs" reads no bitangents, so the meshes drawn with it never use it).
+//
+//  *** "InstanceBuffer(instances)":
+//  - uploads the data of the objects (the motion is calculated in the shader from the time of the camera, so the data does not change while the scene is running).
+//
+//  *** "update(instances)":
+//  - replaces the data with a part of the objects (at most as many as given to the constructor) - used to draw only the objects which are not culled.
+//
+//  *** "updateTimeBrackets(brackets)":
+//  - replaces the time brackets of the instances in the buffer, in the same order.
+//
+//  *** "draw(model, shader)", "draw(model, shader, first, count, level, mode)":
+//  - draws all the instances of the model, or "count" instances from "first" with the level of detail "level" (see "mesh_simplifier.h") as "mode" primitives (GL_PATCHES for the tessellated shaders). OpenGL 4.1 has no base instance in the draw calls, so the instance attributes are pointed at the first instance instead ("bindInstances", also used by the passes which draw the meshes themselves, see "apparent_geometry.h").
+//
+
+#ifndef instance_buffer_h
+#define instance_buffer_h
+
+#include <glad/glad.h>
+#include "glm.hpp"
+
+#include "model.h"
+#include "shader.h"
+#include "gl_state.h"
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// layout of one instance in the buffer, the same as the instance attributes of "sr_ray.vs"
+struct InstanceData {
+    glm::vec4 initial_pos; // xyz - position of the object at t = 0 (IN S FRAME), w - bounding radius of the object
+    glm::vec4 velocity; // xyz - velocity, w - velocity^2
+    glm::mat4 custom;
+    glm::mat4 boost; // Lorentz boost from S' frame to S frame, gamma is boost[0][0]
+};
+
+class InstanceBuffer {
+private:
+    unsigned int VBO = 0;
+    unsigned int bracket_VBO = 0; // vec4 for every instance
+    unsigned int instance_count = 0;
+    unsigned int capacity = 0;
+
+    void release() {
+        if(VBO) glDeleteBuffers(1, &VBO);
+        if(bracket_VBO) glDeleteBuffers(1, &bracket_VBO);
+        VBO = bracket_VBO = 0;
+    }
+
+public:
+    InstanceBuffer(const std::vector<InstanceData>& instances) : instance_count((unsigned int)instances.size()), capacity((unsigned int)instances.size()) {
+        glGenBuffers(1, &VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_DYNAMIC_DRAW);
+        glGenBuffers(1, &bracket_VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, bracket_VBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // the buffer belongs to the OpenGL context, so the object can only be moved
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    InstanceBuffer(InstanceBuffer&& other) noexcept : VBO(other.VBO), bracket_VBO(other.bracket_VBO), instance_count(other.instance_count), capacity(other.capacity) {
+        other.VBO = other.bracket_VBO = 0;
+    }
+
+    InstanceBuffer& operator=(InstanceBuffer&& other) noexcept {
+        if(this != &other) {
+            release();
+            VBO = other.VBO;
+            bracket_VBO = other.bracket_VBO;
+            instance_count = other.instance_count;
+            capacity = other.capacity;
+            other.VBO = other.bracket_VBO = 0;
+        }
+        return *this;
+    }
+
+    ~InstanceBuffer() {
+        release();
+    }
+
+    // point the instance attributes of the mesh to this buffer (from the instance "first") - the same model can be drawn from a few buffers (with different shaders)
+    void bindInstances(const Mesh& mesh, unsigned int first = 0) const {
+        GLState::bindVertexArray(mesh.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+        size_t offset = (size_t)first * sizeof(InstanceData);
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, initial_pos)));
+        glVertexAttribDivisor(6, 1);
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, velocity)));
+        glVertexAttribDivisor(7, 1);
+        // mat4 takes 4 locations, one for each column
+        for(unsigned int i = 0; i < 4; i++) {
+            glEnableVertexAttribArray(8 + i);
+            glVertexAttribPointer(8 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, custom) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(8 + i, 1);
+            glEnableVertexAttribArray(12 + i);
+            glVertexAttribPointer(12 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, boost) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(12 + i, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, bracket_VBO);
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)((size_t)first * sizeof(glm::vec4)));
+        glVertexAttribDivisor(4, 1);
+    }
+
+    inline unsigned int size() const {
+        return instance_count;
+    }
+
+    void update(const std::vector<InstanceData>& instances) {
+        instance_count = (unsigned int)std::min<size_t>(instances.size(), capacity);
+        if(instance_count == 0) return;
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instance_count * sizeof(InstanceData), instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void updateTimeBrackets(const std::vector<glm::vec4>& brackets) {
+        unsigned int count = (unsigned int)std::min<size_t>(brackets.size(), capacity);
+        if(count == 0) return;
+        glBindBuffer(GL_ARRAY_BUFFER, bracket_VBO);
+        // a new store every frame, so the draws of the last frame do not have to finish first
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec4), brackets.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void draw(Model& model, const Shader& shader) const {
+        draw(model, shader, 0, instance_count, 0);
+    }
+
+    void draw(Model& model, const Shader& shader, unsigned int first, unsigned int count, unsigned int level, GLenum mode = GL_TRIANGLES) const {
+        if(first >= instance_count) return;
+        count = std::min(count, instance_count - first);
+        if(count == 0) return;
+        for(unsigned int i = 0; i < model.meshes.size(); i++) {
+            bindInstances(model.meshes[i], first);
+            model.meshes[i].drawInstanced(shader, count, level, mode);
+        }
+    }
+};
+
+#endif /* instance_buffer_h */
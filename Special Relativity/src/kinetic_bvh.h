@@ -0,0 +1,304 @@
+//
+//  kinetic_bvh.h
+//  Special Relativity
+//
+//  Bounding volume hierarchy over the objects of the scene, used to find the objects which can be seen by the camera without testing every one of them. Every object moves uniformly (position + velocity * t), so a node keeps the box of the positions of its objects at the time of the last refit and the bounds of their velocities - the box at any other time is the old box moved by the velocity bounds (it is valid at every time, it only grows looser).
+//  The light reaching the camera at time t was emitted by an object at an earlier time t - d, when the object was at p - v * d (p - its position at t), with |p|/(c + |v|) <= d <= |p|/(c - |v|). A node is skipped if for one of the planes of the frustum every such position of its objects, enlarged by the largest image of its objects, is outside - each plane is tested with the delay bounding its objects on that side (see "nodeVisible"), which is tighter than testing a box swept over all the delays. The objects in the leaves are tested exactly (see "isVisible"), they are stored in the order of the leaves, so a leaf reads them one after another.
+//  Testing a node costs about as much as testing an object, so there is no hierarchy for less than KINETIC_BVH_MIN_ITEMS objects - the root is a leaf with all of them, and the query tests every object (measured with "Benchmark::benchmarkCulling").
+//
+//  *** "build(items, time, speed_of_light)":
+//  - builds the hierarchy from scratch at the given time, splitting the objects at the median of the longest axis of their positions or velocities (VELOCITY_WEIGHT) - the objects moving in different directions drift apart, so they should not share a node.
+//
+//  *** "update(time)":
+//  - refits the boxes at the new time if they have grown too loose since the last refit (REFIT_INFLATION), rebuilds the hierarchy if the refitted boxes are much larger than after the last build (REBUILD_RATIO) - the objects have passed each other, so the nodes overlap.
+//
+//  *** "query(frustum, camera_position, time, show_true_position, result)":
+//  - adds the indices of the objects which can be seen to "result" and returns the number of the objects tested exactly.
+//
+
+#ifndef kinetic_bvh_h
+#define kinetic_bvh_h
+
+#include "glm.hpp"
+
+#include "frustum.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// the boxes are refitted when they have grown by this part of their size since the last refit
+const float KINETIC_BVH_REFIT_INFLATION = 0.25f;
+// the hierarchy is rebuilt when the refitted boxes are this many times larger than after the build
+const float KINETIC_BVH_REBUILD_RATIO = 2.0f;
+const unsigned int KINETIC_BVH_LEAF_SIZE = 8;
+// fewer objects are tested one by one - below this number the hierarchy culls too few of them to pay for its nodes
+const unsigned int KINETIC_BVH_MIN_ITEMS = 3000;
+// the objects are split by their velocities (times this part of the light crossing time of the scene) if they differ more than their positions
+const float KINETIC_BVH_VELOCITY_WEIGHT = 0.25f;
+
+class KineticBVH {
+public:
+    // an object moving uniformly, its image is within "radius" from its origin in its own frame
+    struct Item {
+        glm::vec3 position; // at t = 0 (IN S FRAME)
+        glm::vec3 velocity;
+        float radius;
+    };
+
+private:
+    struct Node {
+        glm::vec3 min, max; // box of the positions of the origins at "reference_time"
+        glm::vec3 velocity_min, velocity_max;
+        float max_radius; // the largest radius of the objects
+        float max_image_radius; // the largest radius of the images of the objects, radius * c / (c - |v|)
+        float max_speed;
+        unsigned int first; // first child (the second one is next to it) or first item in "order"
+        unsigned int count; // number of the items for a leaf, 0 for an inner node
+    };
+
+    std::vector<Item> items;
+    std::vector<unsigned int> order; // items ordered by the leaves
+    std::vector<Item> leaf_items; // copies of the items in the same order
+    std::vector<Node> nodes;
+    float reference_time = 0.0f;
+    float speed_of_light = 1.0f;
+
+    float build_cost = 0.0f; // sum of the surface areas of the nodes after the last build
+    float inflation_rate = 0.0f; // how fast the boxes grow relative to their size
+    float horizon = 0.0f; // a part of the time in which the light crosses the scene - a difference of velocities spreads the objects apart by it times the horizon
+
+    inline glm::vec3 positionAt(const Item& item, float time) const {
+        return item.position + item.velocity * time;
+    }
+
+    inline float imageRadius(const Item& item) const {
+        float speed = glm::length(item.velocity);
+        return speed < speed_of_light ? item.radius * speed_of_light / (speed_of_light - speed) : INFINITY;
+    }
+
+    static inline float surfaceArea(const glm::vec3& min, const glm::vec3& max) {
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    // the box of the node at another time
+    inline void boxAt(const Node& node, float time, glm::vec3& min, glm::vec3& max) const {
+        float dt = time - reference_time;
+        min = node.min + glm::min(node.velocity_min * dt, node.velocity_max * dt);
+        max = node.max + glm::max(node.velocity_min * dt, node.velocity_max * dt);
+    }
+
+    // bounds of the node from its items or from its children
+    void fit(Node& node, float time) {
+        node.min = glm::vec3(INFINITY);
+        node.max = glm::vec3(-INFINITY);
+        node.velocity_min = glm::vec3(INFINITY);
+        node.velocity_max = glm::vec3(-INFINITY);
+        node.max_radius = node.max_image_radius = node.max_speed = 0.0f;
+        if(node.count > 0) {
+            for(unsigned int i = node.first; i < node.first + node.count; i++) {
+                const Item& item = items[order[i]];
+                glm::vec3 position = positionAt(item, time);
+                node.min = glm::min(node.min, position);
+                node.max = glm::max(node.max, position);
+                node.velocity_min = glm::min(node.velocity_min, item.velocity);
+                node.velocity_max = glm::max(node.velocity_max, item.velocity);
+                node.max_radius = std::max(node.max_radius, item.radius);
+                node.max_image_radius = std::max(node.max_image_radius, imageRadius(item));
+                node.max_speed = std::max(node.max_speed, glm::length(item.velocity));
+            }
+        } else {
+            for(unsigned int c = node.first; c < node.first + 2; c++) {
+                const Node& child = nodes[c];
+                node.min = glm::min(node.min, child.min);
+                node.max = glm::max(node.max, child.max);
+                node.velocity_min = glm::min(node.velocity_min, child.velocity_min);
+                node.velocity_max = glm::max(node.velocity_max, child.velocity_max);
+                node.max_radius = std::max(node.max_radius, child.max_radius);
+                node.max_image_radius = std::max(node.max_image_radius, child.max_image_radius);
+                node.max_speed = std::max(node.max_speed, child.max_speed);
+            }
+        }
+    }
+
+    void buildNode(unsigned int index, unsigned int first, unsigned int count, float time) {
+        nodes[index].first = first;
+        nodes[index].count = count;
+        if(count <= KINETIC_BVH_LEAF_SIZE || (index == 0 && count < KINETIC_BVH_MIN_ITEMS)) {
+            fit(nodes[index], time);
+            return;
+        }
+
+        // split at the median of the longest of the 6 axes - 3 of the positions and 3 of the velocities (scaled by the time the light needs to cross the scene), so the objects of a node also move in a similar way and its box does not grow fast
+        glm::vec3 min(INFINITY), max(-INFINITY), velocity_min(INFINITY), velocity_max(-INFINITY);
+        for(unsigned int i = first; i < first + count; i++) {
+            glm::vec3 position = positionAt(items[order[i]], time);
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+            velocity_min = glm::min(velocity_min, items[order[i]].velocity);
+            velocity_max = glm::max(velocity_max, items[order[i]].velocity);
+        }
+        glm::vec3 size = max - min;
+        glm::vec3 velocity_size = (velocity_max - velocity_min) * horizon;
+        int axis = 0;
+        float longest = -1.0f;
+        for(int i = 0; i < 3; i++) {
+            if(size[i] > longest) {
+                longest = size[i];
+                axis = i;
+            }
+            if(velocity_size[i] > longest) {
+                longest = velocity_size[i];
+                axis = 3 + i;
+            }
+        }
+        unsigned int half = count / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count, [&](unsigned int a, unsigned int b) {
+            if(axis >= 3) return items[a].velocity[axis - 3] < items[b].velocity[axis - 3];
+            return positionAt(items[a], time)[axis] < positionAt(items[b], time)[axis];
+        });
+
+        unsigned int children = (unsigned int)nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[index].first = children;
+        nodes[index].count = 0;
+        buildNode(children, first, half, time);
+        buildNode(children + 1, first + half, count - half, time);
+        fit(nodes[index], time);
+    }
+
+    // sum of the surface areas of the nodes - a measure of the cost of a query
+    float cost() const {
+        float area = 0.0f;
+        for(const Node& node : nodes) area += surfaceArea(node.min, node.max);
+        return area;
+    }
+
+    // how fast the boxes grow relative to their size (per unit of time)
+    float inflationRate() const {
+        float growth = 0.0f, size = 0.0f;
+        for(const Node& node : nodes) {
+            growth += glm::length(node.velocity_max - node.velocity_min);
+            size += glm::length(node.max - node.min);
+        }
+        return size > 0.0f ? growth / size : 0.0f;
+    }
+
+    void rebuild(float time) {
+        order.resize(items.size());
+        for(unsigned int i = 0; i < order.size(); i++) order[i] = i;
+        nodes.clear();
+        leaf_items.clear();
+        if(items.empty()) return;
+        glm::vec3 min(INFINITY), max(-INFINITY);
+        for(const Item& item : items) {
+            min = glm::min(min, positionAt(item, time));
+            max = glm::max(max, positionAt(item, time));
+        }
+        horizon = KINETIC_BVH_VELOCITY_WEIGHT * glm::length(max - min) / speed_of_light;
+        nodes.push_back(Node());
+        buildNode(0, 0, (unsigned int)items.size(), time);
+        reference_time = time;
+        leaf_items.resize(items.size());
+        for(unsigned int i = 0; i < order.size(); i++) leaf_items[i] = items[order[i]];
+        build_cost = cost();
+        inflation_rate = inflationRate();
+    }
+
+    void refit(float time) {
+        // the children are always after their parents
+        for(unsigned int i = (unsigned int)nodes.size(); i-- > 0;) fit(nodes[i], time);
+        reference_time = time;
+    }
+
+    // false if the light reaching the camera at "time" from any object of the node comes from outside of one plane of the frustum: a position p - v * d is outside of a plane (normal n) if n.p - d * n.v + w < -(radius of the image) - the largest n.p over the box, with the smallest n.v over the velocities and the delay bounding the term on its side
+    bool nodeVisible(const Node& node, const Frustum& frustum, const glm::vec3& camera_position, float time) const {
+        glm::vec3 min, max;
+        boxAt(node, time, min, max);
+        // positions relative to the camera at "time"
+        glm::vec3 p_min = min - camera_position, p_max = max - camera_position;
+        float p_near = glm::length(glm::clamp(glm::vec3(0.0f), p_min, p_max));
+        float p_far = glm::length(glm::max(glm::abs(p_min), glm::abs(p_max)));
+        float shortest = p_near/(speed_of_light + node.max_speed), longest = p_far/(speed_of_light - node.max_speed);
+        for(int i = 0; i < 6; i++) {
+            const glm::vec4& plane = frustum.planes[i];
+            float distance = plane.w, approach = 0.0f;
+            for(int axis = 0; axis < 3; axis++) {
+                distance += plane[axis] > 0.0f ? plane[axis]*p_max[axis] : plane[axis]*p_min[axis];
+                approach += plane[axis] > 0.0f ? plane[axis]*node.velocity_min[axis] : plane[axis]*node.velocity_max[axis];
+            }
+            if(distance - (approach < 0.0f ? longest : shortest)*approach < -node.max_image_radius) return false;
+        }
+        return true;
+    }
+
+public:
+    void build(const std::vector<Item>& new_items, float time, float c = 1.0f) {
+        items = new_items;
+        speed_of_light = c;
+        rebuild(time);
+    }
+
+    // returns true if the boxes were refitted or rebuilt
+    bool update(float time) {
+        if(nodes.empty() || std::abs(time - reference_time) * inflation_rate < KINETIC_BVH_REFIT_INFLATION) return false;
+        refit(time);
+        if(cost() > KINETIC_BVH_REBUILD_RATIO * build_cost) rebuild(time);
+        else inflation_rate = inflationRate();
+        return true;
+    }
+
+    inline unsigned int size() const {
+        return (unsigned int)items.size();
+    }
+
+    // the exact test of one object - the sphere around the apparent position of its origin (the position at the time found as in "Scene::findTime"), stretched by the light travel time
+    static bool isVisible(const Frustum& frustum, const Item& item, const glm::vec3& camera_position, float time, float speed_of_light, bool show_true_position) {
+        float speed = glm::length(item.velocity);
+        if(speed >= speed_of_light) return true;
+        if(show_true_position) return frustum.intersectsSphere(item.position + item.velocity*time - camera_position, item.radius);
+
+        glm::vec3 beta = item.velocity/speed_of_light;
+        glm::vec3 alpha = (camera_position - item.position)/speed_of_light;
+        float beta_2 = 1-glm::dot(beta, beta);
+        float alpha_2 = glm::dot(alpha, alpha);
+        float adb = time-glm::dot(alpha, beta);
+        float emission_time = (adb - glm::sqrt(adb*adb+beta_2*(alpha_2-time*time)))/beta_2;
+
+        return frustum.intersectsSphere(item.position + item.velocity*emission_time - camera_position, item.radius*speed_of_light/(speed_of_light - speed));
+    }
+
+    unsigned int query(const Frustum& frustum, const glm::vec3& camera_position, float time, bool show_true_position, std::vector<unsigned int>& result) const {
+        if(nodes.empty()) return 0;
+        unsigned int tested = 0;
+        unsigned int stack[64];
+        unsigned int stack_size = 0;
+        stack[stack_size++] = 0;
+        while(stack_size > 0) {
+            const Node& node = nodes[stack[--stack_size]];
+
+            if(node.max_speed < speed_of_light) {
+                if(show_true_position) {
+                    glm::vec3 min, max;
+                    boxAt(node, time, min, max);
+                    if(!frustum.intersectsBox(min - camera_position - glm::vec3(node.max_radius), max - camera_position + glm::vec3(node.max_radius))) continue;
+                } else if(!nodeVisible(node, frustum, camera_position, time)) continue;
+            }
+
+            if(node.count > 0) {
+                for(unsigned int i = node.first; i < node.first + node.count; i++) {
+                    tested++;
+                    if(isVisible(frustum, leaf_items[i], camera_position, time, speed_of_light, show_true_position)) result.push_back(order[i]);
+                }
+            } else {
+                stack[stack_size++] = node.first;
+                stack[stack_size++] = node.first + 1;
+            }
+        }
+        return tested;
+    }
+};
+
+#endif /* kinetic_bvh_h */
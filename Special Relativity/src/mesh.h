@@ -11,12 +11,18 @@
 #include "gtc/matrix_transform.hpp"
 
 #include "shader.h"
+#include "gl_state.h"
+#include "vertex_format.h"
 
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <utility>
+#include <cstring>
+#include <algorithm>
 
 struct Vertex {
     glm::vec3 Position;
@@ -32,74 +38,308 @@ struct Texture {
     std::string path;
 };
 
+// texture of a mesh which has not been loaded yet
+struct TextureReference {
+    std::string type;
+    std::string path; // relative to the directory of the model
+    
+    // filled by "Model::import" (they are not stored in the cache), used to share the textures (see "texture_registry.h")
+    std::string file; // resolved path
+    std::uint64_t hash = 0; // hash of the content of the file, 0 if it cannot be read
+    size_t bytes = 0; // estimated size of the texture on the GPU
+};
+
+// level of detail of a mesh - a part of its index array (see "mesh_simplifier.h")
+struct MeshLOD {
+    unsigned int first_index, index_count;
+    unsigned int vertex_count; // number of the vertices used by the level
+    float error; // estimated distance of the surface from the full mesh (in the units of the model)
+};
+
+// the vertices of a level of detail listed once and the triangles of the level indexing that list - a level drawn from the vertices solved once per frame (see "apparent_geometry.h")
+struct MeshPointLevel {
+    unsigned int first_point, point_count; // the list of the vertices in the index buffer
+    unsigned int first_index; // the triangles, as many indices as in the level
+};
+
+// the arrays of a mesh prepared on the CPU (they can be made on any thread), "vertex_data" and "index_data" point to "vertices" and "indices" (null if the mesh was read from the cache)
+// the buffers sent to the GPU are made by "pack" - "vertex_buffer" and "index_buffer" point either to "packed_vertices" and "packed_indices" or to the mapped cache file (see "mesh_cache.h")
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    const Vertex* vertex_data = nullptr;
+    const unsigned int* index_data = nullptr;
+    unsigned int vertex_count = 0, index_count = 0;
+    std::vector<TextureReference> textures;
+    std::vector<MeshLOD> lods; // empty - all the indices are one level
+    
+    std::vector<unsigned char> packed_vertices, packed_indices;
+    const unsigned char* vertex_buffer = nullptr;
+    const unsigned char* index_buffer = nullptr;
+    unsigned int index_size = sizeof(unsigned int); // in bytes, 2 if the mesh has at most 65536 vertices
+    
+    // point the arrays to "vertices" and "indices"
+    void own() {
+        vertex_data = vertices.data();
+        index_data = indices.data();
+        vertex_count = (unsigned int)vertices.size();
+        index_count = (unsigned int)indices.size();
+    }
+    
+    // convert the arrays to the buffers sent to the GPU - the vertices in the layout of "format" (see "vertex_format.h"), the indices 16-bit if they fit
+    void pack(const VertexFormat& format) {
+        packed_vertices = packVertices(vertex_data, vertex_count, format);
+        index_size = indexSize(vertex_count);
+        packed_indices.resize((size_t)index_count * index_size);
+        if(index_size == sizeof(unsigned short)) {
+            unsigned short* short_indices = (unsigned short*)packed_indices.data();
+            for(unsigned int i = 0; i < index_count; i++) short_indices[i] = (unsigned short)index_data[i];
+        } else if(index_count > 0) std::memcpy(packed_indices.data(), index_data, packed_indices.size());
+        vertex_buffer = packed_vertices.data();
+        index_buffer = packed_indices.data();
+    }
+    
+    inline size_t vertexBufferSize(const VertexFormat& format) const {
+        return (size_t)vertex_count * format.layout().stride;
+    }
+    
+    inline size_t indexBufferSize() const {
+        return (size_t)index_count * index_size;
+    }
+    
+    static inline unsigned int indexSize(unsigned int vertex_count) {
+        return vertex_count <= 65536 ? sizeof(unsigned short) : sizeof(unsigned int);
+    }
+    
+    // convert the vertices to the layout of the format
+    static std::vector<unsigned char> packVertices(const Vertex* vertex_data, unsigned int vertex_count, const VertexFormat& format) {
+        VertexFormat::Layout layout = format.layout();
+        std::vector<unsigned char> packed((size_t)vertex_count * layout.stride);
+        for(unsigned int i = 0; i < vertex_count; i++) {
+            const Vertex& vertex = vertex_data[i];
+            unsigned char* out = &packed[(size_t)i * layout.stride];
+            std::memcpy(out, &vertex.Position, sizeof(glm::vec3));
+            if(layout.normal >= 0) {
+                if(format.octahedral_normals) {
+                    unsigned int normal = glm::packSnorm2x16(VertexFormat::octahedralEncode(vertex.Normal));
+                    std::memcpy(out + layout.normal, &normal, sizeof(normal));
+                } else std::memcpy(out + layout.normal, &vertex.Normal, sizeof(glm::vec3));
+            }
+            if(layout.tex_coords >= 0) {
+                if(format.half_tex_coords) {
+                    unsigned int tex_coords = glm::packHalf2x16(vertex.TexCoords);
+                    std::memcpy(out + layout.tex_coords, &tex_coords, sizeof(tex_coords));
+                } else std::memcpy(out + layout.tex_coords, &vertex.TexCoords, sizeof(glm::vec2));
+            }
+            if(layout.tangent >= 0) std::memcpy(out + layout.tangent, &vertex.Tangent, sizeof(glm::vec3));
+            if(layout.bitangent >= 0) std::memcpy(out + layout.bitangent, &vertex.Bitangent, sizeof(glm::vec3));
+        }
+        return packed;
+    }
+};
+
 class Mesh {
 public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
-    unsigned int VAO;
+    unsigned int VAO = 0;
+    unsigned int vertex_count, index_count; // "index_count" - of the full mesh, the other levels follow it in the buffer
+    std::vector<MeshLOD> lods; // at least one level - the full mesh
+    std::vector<MeshPointLevel> point_levels; // for every level, empty until "preparePointLevels"
     
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures) {
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, const VertexFormat& format = VertexFormat()) {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        vertex_count = (unsigned int)vertices.size();
+        index_count = (unsigned int)indices.size();
+        lods.push_back({0, index_count, vertex_count, 0.0f});
 
-        setupMesh();
+        MeshData data;
+        data.vertex_data = this->vertices.data();
+        data.index_data = this->indices.data();
+        data.vertex_count = vertex_count;
+        data.index_count = index_count;
+        data.pack(format);
+        setupMesh(data, format);
+    }
+    
+    // upload the buffers made by "MeshData::pack" straight to the GPU (for example from the mapped cache file, see "mesh_cache.h"), the mesh keeps no copy of them in "vertices" and "indices"
+    // "format" has to be the one the buffers were packed in, the indices are all the levels of detail in "lods" (none - the indices are the full mesh)
+    Mesh(const MeshData& data, std::vector<Texture> textures, const VertexFormat& format = VertexFormat()) : vertex_count(data.vertex_count), lods(data.lods) {
+        this->textures = textures;
+        if(lods.empty()) lods.push_back({0, data.index_count, vertex_count, 0.0f});
+        index_count = lods[0].index_count;
+        
+        setupMesh(data, format);
+    }
+    
+    // the buffers belong to the OpenGL context, so the mesh can only be moved
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    
+    Mesh(Mesh&& other) noexcept : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)), VAO(other.VAO), vertex_count(other.vertex_count), index_count(other.index_count), lods(std::move(other.lods)), point_levels(std::move(other.point_levels)), VBO(other.VBO), EBO(other.EBO), index_type(other.index_type), sampler_names(std::move(other.sampler_names)) {
+        other.VAO = other.VBO = other.EBO = 0;
+    }
+    
+    Mesh& operator=(Mesh&& other) noexcept {
+        if(this != &other) {
+            release();
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            VAO = other.VAO;
+            VBO = other.VBO;
+            EBO = other.EBO;
+            index_type = other.index_type;
+            vertex_count = other.vertex_count;
+            index_count = other.index_count;
+            lods = std::move(other.lods);
+            point_levels = std::move(other.point_levels);
+            sampler_names = std::move(other.sampler_names);
+            other.VAO = other.VBO = other.EBO = 0;
+        }
+        return *this;
+    }
+    
+    // the textures are owned by the model
+    ~Mesh() {
+        release();
+    }
+    
+    void draw(const Shader& shader) {
+        bindTextures(shader);
+        
+        GLState::bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, index_count, index_type, 0);
+    }
+    
+    // draw "instance_count" copies of the mesh, the per-instance attributes have to be set up in the VAO before
+    // "level" - of detail, the simplest level of the mesh is used if it has fewer, "mode" - GL_PATCHES for the shaders with the tessellation stages
+    void drawInstanced(const Shader& shader, unsigned int instance_count, unsigned int level = 0, GLenum mode = GL_TRIANGLES) {
+        bindTextures(shader);
+        
+        const MeshLOD& lod = lods[std::min<size_t>(level, lods.size() - 1)];
+        GLState::bindVertexArray(VAO);
+        glDrawElementsInstanced(mode, lod.index_count, index_type, indexOffset(lod.first_index), instance_count);
     }
     
-    void draw(Shader shader) {
+    // append the point levels to the index buffer, the indices are read back from the GPU (the mesh keeps no copy of them) - only the first time, the meshes which are never drawn from the solved vertices do not grow
+    void preparePointLevels() {
+        if(!point_levels.empty()) return;
+        unsigned int total_count = 0;
+        for(const MeshLOD& lod : lods) total_count = std::max(total_count, lod.first_index + lod.index_count);
         
+        std::vector<unsigned int> index_data(total_count);
+        GLState::bindVertexArray(VAO);
+        if(index_type == GL_UNSIGNED_SHORT) {
+            std::vector<unsigned short> short_indices(total_count);
+            glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, total_count * sizeof(unsigned short), short_indices.data());
+            index_data.assign(short_indices.begin(), short_indices.end());
+        } else glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, total_count * sizeof(unsigned int), index_data.data());
+        
+        // the vertices are listed in the order of their first use, so the solved vertices are read in about the same order
+        std::vector<unsigned int> point(vertex_count), point_level(vertex_count, (unsigned int)lods.size());
+        for(unsigned int level = 0; level < lods.size(); level++) {
+            const MeshLOD& lod = lods[level];
+            MeshPointLevel points;
+            points.first_point = (unsigned int)index_data.size();
+            for(unsigned int i = lod.first_index; i < lod.first_index + lod.index_count; i++) {
+                unsigned int vertex = index_data[i];
+                if(point_level[vertex] == level) continue;
+                point_level[vertex] = level;
+                point[vertex] = (unsigned int)index_data.size() - points.first_point;
+                index_data.push_back(vertex);
+            }
+            points.point_count = (unsigned int)index_data.size() - points.first_point;
+            points.first_index = (unsigned int)index_data.size();
+            for(unsigned int i = lod.first_index; i < lod.first_index + lod.index_count; i++) index_data.push_back(point[index_data[i]]);
+            point_levels.push_back(points);
+        }
+        
+        if(index_type == GL_UNSIGNED_SHORT) {
+            std::vector<unsigned short> short_indices(index_data.begin(), index_data.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_indices.size() * sizeof(unsigned short), short_indices.data(), GL_STATIC_DRAW);
+        } else glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_data.size() * sizeof(unsigned int), index_data.data(), GL_STATIC_DRAW);
+    }
+    
+    inline const MeshPointLevel& pointLevel(unsigned int level) const {
+        return point_levels[std::min<size_t>(level, point_levels.size() - 1)];
+    }
+    
+    // every vertex of the level once for every instance, as points - the transform feedback records them in the order of the point list (see "preparePointLevels")
+    void drawPointsInstanced(unsigned int instance_count, unsigned int level) {
+        const MeshPointLevel& points = pointLevel(level);
+        GLState::bindVertexArray(VAO);
+        glDrawElementsInstanced(GL_POINTS, points.point_count, index_type, indexOffset(points.first_point), instance_count);
+    }
+    
+    // the triangles of the level with the indices in the point list, the vertex shader reads the vertex "gl_VertexID" of the instance from the solved vertices
+    void drawFromPointsInstanced(const Shader& shader, unsigned int instance_count, unsigned int level) {
+        bindTextures(shader);
+        
+        const MeshLOD& lod = lods[std::min<size_t>(level, lods.size() - 1)];
+        GLState::bindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, lod.index_count, index_type, indexOffset(pointLevel(level).first_index), instance_count);
+    }
+private:
+    unsigned int VBO = 0, EBO = 0;
+    GLenum index_type = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT if the mesh has at most 65536 vertices
+    std::vector<std::string> sampler_names; // name of the sampler of every texture, e.g. "texture_diffuse1"
+    
+    // byte offset of the index in the index buffer
+    inline void* indexOffset(unsigned int index) const {
+        return (void*)((size_t)index * (index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int)));
+    }
+    
+    void release() {
+        if(VAO) {
+            GLState::forgetVertexArray(VAO);
+            glDeleteVertexArrays(1, &VAO);
+        }
+        if(VBO) glDeleteBuffers(1, &VBO);
+        if(EBO) glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
+    
+    void bindTextures(const Shader& shader) {
+        for(unsigned int i = 0; i < textures.size(); i++) {
+            shader.setInt(sampler_names[i], i);
+            GLState::bindTexture(i, textures[i].ID);
+        }
+    }
+    
+    void setupMesh(const MeshData& data, const VertexFormat& format) {
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
         
         for(unsigned int i = 0; i < textures.size(); i++) {
-            glActiveTexture(GL_TEXTURE0 + i);
-            
             std::string number;
             std::string type = textures[i].type;
             if(type == "texture_diffuse") number = std::to_string(diffuseNr++);
             else if(type == "texture_specular") number = std::to_string(specularNr++);
             else if(type == "texture_normal") number = std::to_string(normalNr++);
             else if(type == "texture_height") number = std::to_string(heightNr++);
-            
-            glUniform1i(glGetUniformLocation(shader.ID, (type + number).c_str()), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].ID);
+            sampler_names.push_back(type + number);
         }
         
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        
-        glActiveTexture(GL_TEXTURE0);
-    }
-private:
-    unsigned int VBO, EBO;
-    
-    void setupMesh() {
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
         
-        glBindVertexArray(VAO);
+        GLState::bindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, data.vertexBufferSize(format), data.vertex_buffer, GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indexBufferSize(), data.index_buffer, GL_STATIC_DRAW);
+        index_type = data.index_size == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
         
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        format.setAttributePointers();
         
-        glBindVertexArray(0);
+        GLState::bindVertexArray(0);
     }
 };
 
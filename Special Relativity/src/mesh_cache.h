@@ -0,0 +1,337 @@
+//
+//  mesh_cache.h
+//  Special Relativity
+//
+//  Binary cache of the processed models, so the OBJ files do not have to be parsed by Assimp at every start. The cache of "assets/objects/x/x.obj" is kept in the "cache" folder, in a file named after the hash of the path.
+//  The file holds the vertex and index buffers of all the meshes exactly as they are sent to the GPU (see "MeshData::pack" - the vertices in the layout of the vertex format, the indices 16-bit if they fit; aligned to 16 bytes, so the file can be mapped to memory and the buffers uploaded from it without a copy), the levels of detail (see "mesh_simplifier.h") and the texture references (type and path) of every mesh.
+//  The cache is used only if it has the same version and vertex format, it was made from the same path and the source file has not changed - the modification time and the size are compared first, if they differ the content hash decides.
+//  The textures are referenced in the MTL file, which is not checked - remove the "cache" folder after changing it.
+//
+//  Every vertex format of a model (see "VertexFormat::code", the same key as in "model_registry.h") is cached in a separate file.
+//
+//  *** "MeshCache::load(path, format)":
+//  - maps the cache of the model to memory, "isValid()" is false if there is no valid cache.
+//
+//  *** "MeshCache::save(path, meshes, bounding_radius, format)":
+//  - writes the cache of the model, the meshes have to be packed in "format".
+//
+
+#ifndef mesh_cache_h
+#define mesh_cache_h
+
+#include "mesh.h"
+#include "hash.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <functional>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+const char* const MESH_CACHE_DIRECTORY = "cache";
+const std::uint32_t MESH_CACHE_VERSION = 5; // 2 - the meshes are optimised (see "mesh_optimizer.h"), 3 - the levels of detail (see "mesh_simplifier.h"), 4 - the buffers packed in the vertex format, 5 - the scores of the triangles updated when their vertices leave the cache
+
+// read-only view of a whole file mapped to memory
+class MappedFile {
+private:
+    void* mapping = nullptr;
+    size_t length = 0;
+
+public:
+    MappedFile(const std::string& path) {
+        int file = open(path.c_str(), O_RDONLY);
+        if(file < 0) return;
+        struct stat info;
+        if(fstat(file, &info) == 0 && info.st_size > 0) {
+            void* result = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if(result != MAP_FAILED) {
+                mapping = result;
+                length = (size_t)info.st_size;
+            }
+        }
+        close(file);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept : mapping(other.mapping), length(other.length) {
+        other.mapping = nullptr;
+        other.length = 0;
+    }
+
+    ~MappedFile() {
+        if(mapping) munmap(mapping, length);
+    }
+
+    inline const unsigned char* data() const {
+        return (const unsigned char*)mapping;
+    }
+
+    inline size_t size() const {
+        return length;
+    }
+};
+
+class MeshCache {
+private:
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t vertex_format; // "VertexFormat::code" of the packed vertices
+        std::uint64_t source_mtime; // in nanoseconds
+        std::uint64_t source_size;
+        std::uint64_t source_hash;
+        std::uint32_t path_length; // the path of the source follows the header
+        std::uint32_t mesh_count; // MeshHeaders follow the path (aligned to 16 bytes)
+        float bounding_radius;
+        std::uint32_t vertex_stride; // of the layout of the format - the cache is invalid if the layout changes
+    };
+
+    struct MeshHeader {
+        std::uint64_t vertices_offset; // offsets from the beginning of the file
+        std::uint64_t indices_offset;
+        std::uint64_t textures_offset; // texture references: for every texture - the length of the type, the type, the length of the path, the path
+        std::uint64_t lods_offset; // MeshLODs
+        std::uint32_t vertex_count;
+        std::uint32_t index_count; // of all the levels
+        std::uint32_t texture_count;
+        std::uint32_t lod_count;
+        std::uint32_t index_size; // in bytes
+        std::uint32_t padding;
+    };
+
+    MappedFile file;
+    const Header* header = nullptr;
+    const MeshHeader* mesh_headers = nullptr;
+
+    MeshCache(const std::string& cache_path) : file(cache_path) {}
+
+    static inline size_t align(size_t offset) {
+        return (offset + 15) / 16 * 16;
+    }
+
+    static std::string cachePath(const std::string& path, const VertexFormat& format) {
+        std::uint64_t value = hash((const unsigned char*)path.data(), path.size());
+        std::string key = "#" + std::to_string(format.code());
+        value = hash((const unsigned char*)key.data(), key.size(), value);
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)value);
+        return std::string(MESH_CACHE_DIRECTORY) + "/" + name;
+    }
+
+    static bool sourceInfo(const std::string& path, std::uint64_t& mtime, std::uint64_t& size) {
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0) return false;
+        #ifdef __APPLE__
+        mtime = (std::uint64_t)info.st_mtimespec.tv_sec * 1000000000ull + (std::uint64_t)info.st_mtimespec.tv_nsec;
+        #else
+        mtime = (std::uint64_t)info.st_mtim.tv_sec * 1000000000ull + (std::uint64_t)info.st_mtim.tv_nsec;
+        #endif
+        size = (std::uint64_t)info.st_size;
+        return true;
+    }
+
+    bool check(const std::string& path, const VertexFormat& format) {
+        if(file.size() < sizeof(Header)) return false;
+        const Header* h = (const Header*)file.data();
+        if(std::memcmp(h->magic, "SRMESH\0\0", 8) != 0 || h->version != MESH_CACHE_VERSION || h->vertex_format != format.code() || h->vertex_stride != format.layout().stride) return false;
+        if(file.size() < sizeof(Header) + h->path_length || path.compare(0, std::string::npos, (const char*)file.data() + sizeof(Header), h->path_length) != 0) return false;
+
+        std::uint64_t mtime, size;
+        if(!sourceInfo(path, mtime, size) || size != h->source_size) return false;
+        if(mtime != h->source_mtime && hashFile(path) != h->source_hash) return false;
+
+        size_t meshes_offset = align(sizeof(Header) + h->path_length);
+        if(file.size() < meshes_offset + h->mesh_count * sizeof(MeshHeader)) return false;
+        const MeshHeader* m = (const MeshHeader*)(file.data() + meshes_offset);
+        for(std::uint32_t i = 0; i < h->mesh_count; i++) {
+            if(m[i].index_size != MeshData::indexSize(m[i].vertex_count)) return false;
+            if(m[i].vertices_offset + (std::uint64_t)m[i].vertex_count * h->vertex_stride > file.size()) return false;
+            if(m[i].indices_offset + (std::uint64_t)m[i].index_count * m[i].index_size > file.size()) return false;
+            if(m[i].textures_offset > file.size()) return false;
+            if(m[i].lods_offset + (std::uint64_t)m[i].lod_count * sizeof(MeshLOD) > file.size()) return false;
+        }
+
+        header = h;
+        mesh_headers = m;
+        return true;
+    }
+
+    static void writeString(std::vector<unsigned char>& data, const std::string& text) {
+        std::uint32_t length = (std::uint32_t)text.size();
+        data.insert(data.end(), (const unsigned char*)&length, (const unsigned char*)&length + sizeof(length));
+        data.insert(data.end(), text.begin(), text.end());
+    }
+
+    static inline void writeAt(std::vector<unsigned char>& data, size_t offset, const void* source, size_t size) {
+        if(data.size() < offset + size) data.resize(offset + size);
+        if(size > 0) std::memcpy(&data[offset], source, size);
+    }
+
+public:
+    static inline std::uint64_t hash(const unsigned char* data, size_t size, std::uint64_t value = FNV_OFFSET_BASIS) {
+        return fnv1a(data, size, value);
+    }
+
+    // hash of the content of the file, 0 if it cannot be read
+    static std::uint64_t hashFile(const std::string& path) {
+        MappedFile source(path);
+        if(!source.data()) return 0;
+        return hash(source.data(), source.size());
+    }
+
+    static MeshCache load(const std::string& path, const VertexFormat& format = VertexFormat()) {
+        MeshCache cache(cachePath(path, format));
+        cache.check(path, format);
+        return cache;
+    }
+
+    MeshCache(MeshCache&& other) noexcept : file(std::move(other.file)), header(other.header), mesh_headers(other.mesh_headers) {
+        other.header = nullptr;
+        other.mesh_headers = nullptr;
+    }
+
+    inline bool isValid() const {
+        return header != nullptr;
+    }
+
+    inline unsigned int meshCount() const {
+        return header->mesh_count;
+    }
+
+    inline float boundingRadius() const {
+        return header->bounding_radius;
+    }
+
+    // the buffers point to the mapped file, they are valid as long as the cache exists
+    inline const unsigned char* vertexBuffer(unsigned int mesh) const {
+        return file.data() + mesh_headers[mesh].vertices_offset;
+    }
+
+    inline unsigned int vertexCount(unsigned int mesh) const {
+        return mesh_headers[mesh].vertex_count;
+    }
+
+    inline const unsigned char* indexBuffer(unsigned int mesh) const {
+        return file.data() + mesh_headers[mesh].indices_offset;
+    }
+    
+    inline unsigned int indexSize(unsigned int mesh) const {
+        return mesh_headers[mesh].index_size;
+    }
+
+    inline unsigned int indexCount(unsigned int mesh) const {
+        return mesh_headers[mesh].index_count;
+    }
+
+    std::vector<MeshLOD> lods(unsigned int mesh) const {
+        const MeshLOD* first = (const MeshLOD*)(file.data() + mesh_headers[mesh].lods_offset);
+        std::vector<MeshLOD> levels(first, first + mesh_headers[mesh].lod_count);
+        for(const MeshLOD& lod : levels) {
+            if((std::uint64_t)lod.first_index + lod.index_count > mesh_headers[mesh].index_count) return std::vector<MeshLOD>();
+        }
+        return levels;
+    }
+
+    std::vector<TextureReference> textures(unsigned int mesh) const {
+        std::vector<TextureReference> references;
+        size_t offset = (size_t)mesh_headers[mesh].textures_offset;
+        for(std::uint32_t i = 0; i < mesh_headers[mesh].texture_count; i++) {
+            TextureReference reference;
+            for(std::string* text : {&reference.type, &reference.path}) {
+                std::uint32_t length;
+                if(offset + sizeof(length) > file.size()) return references;
+                std::memcpy(&length, file.data() + offset, sizeof(length));
+                offset += sizeof(length);
+                if(offset + length > file.size()) return references;
+                text->assign((const char*)file.data() + offset, length);
+                offset += length;
+            }
+            references.push_back(reference);
+        }
+        return references;
+    }
+
+    static void save(const std::string& path, const std::vector<MeshData>& meshes, float bounding_radius, const VertexFormat& format = VertexFormat()) {
+        Header h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, "SRMESH\0\0", 8);
+        h.version = MESH_CACHE_VERSION;
+        h.vertex_format = format.code();
+        h.vertex_stride = format.layout().stride;
+        if(!sourceInfo(path, h.source_mtime, h.source_size)) return;
+        h.source_hash = hashFile(path);
+        h.path_length = (std::uint32_t)path.size();
+        h.mesh_count = (std::uint32_t)meshes.size();
+        h.bounding_radius = bounding_radius;
+
+        std::vector<unsigned char> data;
+        writeAt(data, 0, &h, sizeof(h));
+        writeAt(data, sizeof(h), path.data(), path.size());
+
+        size_t meshes_offset = align(sizeof(h) + path.size());
+        size_t offset = align(meshes_offset + meshes.size() * sizeof(MeshHeader));
+        for(unsigned int i = 0; i < meshes.size(); i++) {
+            MeshHeader m;
+            std::memset(&m, 0, sizeof(m));
+            m.vertex_count = meshes[i].vertex_count;
+            m.index_count = meshes[i].index_count;
+            m.texture_count = (std::uint32_t)meshes[i].textures.size();
+            m.lod_count = (std::uint32_t)meshes[i].lods.size();
+            m.index_size = meshes[i].index_size;
+
+            m.vertices_offset = offset;
+            writeAt(data, offset, meshes[i].vertex_buffer, meshes[i].vertexBufferSize(format));
+            offset = align(offset + meshes[i].vertexBufferSize(format));
+
+            m.indices_offset = offset;
+            writeAt(data, offset, meshes[i].index_buffer, meshes[i].indexBufferSize());
+            offset = align(offset + meshes[i].indexBufferSize());
+
+            m.lods_offset = offset;
+            writeAt(data, offset, meshes[i].lods.data(), meshes[i].lods.size() * sizeof(MeshLOD));
+            offset = align(offset + meshes[i].lods.size() * sizeof(MeshLOD));
+
+            m.textures_offset = offset;
+            std::vector<unsigned char> references;
+            for(const TextureReference& texture : meshes[i].textures) {
+                writeString(references, texture.type);
+                writeString(references, texture.path);
+            }
+            writeAt(data, offset, references.data(), references.size());
+            offset = align(offset + references.size());
+
+            writeAt(data, meshes_offset + i * sizeof(MeshHeader), &m, sizeof(m));
+        }
+        data.resize(offset);
+
+        mkdir(MESH_CACHE_DIRECTORY, 0755);
+        // write to a temporary file first, so a cache which is being written is never read (one per thread - the same model can be imported by two threads at once)
+        std::string cache_path = cachePath(path, format);
+        std::string temporary_path = cache_path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        FILE* output = std::fopen(temporary_path.c_str(), "wb");
+        if(!output) {
+            std::cout << "ERROR::MESH_CACHE: Could not write the cache of: " << path << std::endl;
+            return;
+        }
+        bool written = std::fwrite(data.data(), 1, data.size(), output) == data.size();
+        written = std::fclose(output) == 0 && written;
+        if(!written || std::rename(temporary_path.c_str(), cache_path.c_str()) != 0) {
+            std::cout << "ERROR::MESH_CACHE: Could not write the cache of: " << path << std::endl;
+            std::remove(temporary_path.c_str());
+        }
+    }
+};
+
+#endif /* mesh_cache_h */
@@ -0,0 +1,239 @@
+//
+//  mesh_optimizer.h
+//  Special Relativity
+//
+//  Optimisation of the meshes done once, when a model is imported (the result is stored in the cache, see "mesh_cache.h"). Every vertex of a relativistic object runs the solver of the light cone equation, so every duplicated vertex and every vertex transformed again after missing the post-transform cache costs a lot:
+//  - the identical vertices are welded (Assimp gives every face of an OBJ file its own vertices),
+//  - the triangles are reordered for the post-transform cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"),
+//  - the vertices are reordered in the order of their first use, so they are fetched sequentially.
+//  The meshes with at most 65536 vertices are drawn with 16-bit indices (see "mesh.h").
+//
+//  *** "MeshOptimizer::optimize(mesh, name)":
+//  - optimises the mesh and prints the number of vertices and the average cache miss ratio (ACMR - transformed vertices per triangle, 0.5 is the best possible, 3 the worst) before and after.
+//
+
+#ifndef mesh_optimizer_h
+#define mesh_optimizer_h
+
+#include "glm.hpp"
+
+#include "mesh.h"
+#include "hash.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+
+// size of the simulated post-transform cache
+const unsigned int VERTEX_CACHE_SIZE = 32;
+
+class MeshOptimizer {
+private:
+    // vertices compared by their bytes
+    struct VertexHash {
+        size_t operator()(const Vertex& vertex) const {
+            return (size_t)fnv1a(&vertex, sizeof(Vertex));
+        }
+    };
+
+    struct VertexEqual {
+        bool operator()(const Vertex& a, const Vertex& b) const {
+            return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+        }
+    };
+
+    static void weld(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+        std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+        std::vector<Vertex> welded;
+        std::vector<unsigned int> remap(vertices.size());
+        for(unsigned int i = 0; i < vertices.size(); i++) {
+            std::pair<std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual>::iterator, bool> it = unique.insert(std::make_pair(vertices[i], (unsigned int)welded.size()));
+            if(it.second) welded.push_back(vertices[i]);
+            remap[i] = it.first->second;
+        }
+        for(unsigned int& index : indices) index = remap[index];
+        vertices.swap(welded);
+    }
+
+    // score of a vertex in Forsyth's algorithm - high for the vertices at the front of the cache and for the vertices with few triangles left
+    static float vertexScore(int cache_position, unsigned int remaining_triangles) {
+        if(remaining_triangles == 0) return -1.0f;
+        float score = 0.0f;
+        if(cache_position >= 0) {
+            if(cache_position < 3) score = 0.75f; // the last triangle - a fixed score, so the strips do not get a preferred direction
+            else score = std::pow(1.0f - (cache_position - 3) / float(VERTEX_CACHE_SIZE - 3), 1.5f);
+        }
+        return score + 2.0f / std::sqrt((float)remaining_triangles); // finish the vertices with few triangles left first
+    }
+
+    static inline float triangleScore(const std::vector<unsigned int>& indices, const std::vector<float>& vertex_scores, unsigned int t) {
+        return vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]] + vertex_scores[indices[3 * t + 2]];
+    }
+
+    struct Candidate {
+        float score;
+        unsigned int triangle;
+
+        // the order of "std::priority_queue" - the highest score, then the lowest triangle on the top
+        bool operator<(const Candidate& other) const {
+            return score < other.score || (score == other.score && triangle > other.triangle);
+        }
+    };
+
+    static void reorderTriangles(std::vector<unsigned int>& indices, unsigned int vertex_count) {
+        unsigned int triangle_count = (unsigned int)indices.size() / 3;
+        if(triangle_count == 0) return;
+
+        // triangles of every vertex
+        std::vector<unsigned int> first(vertex_count + 1, 0);
+        for(unsigned int index : indices) first[index + 1]++;
+        for(unsigned int i = 0; i < vertex_count; i++) first[i + 1] += first[i];
+        std::vector<unsigned int> vertex_triangles(indices.size());
+        std::vector<unsigned int> remaining(vertex_count, 0);
+        for(unsigned int t = 0; t < triangle_count; t++) {
+            for(unsigned int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * t + k];
+                vertex_triangles[first[v] + remaining[v]++] = t;
+            }
+        }
+
+        std::vector<float> vertex_scores(vertex_count);
+        for(unsigned int v = 0; v < vertex_count; v++) vertex_scores[v] = vertexScore(-1, remaining[v]);
+        std::vector<float> triangle_scores(triangle_count);
+        std::vector<bool> added(triangle_count, false);
+        // the triangles for the restart (when no triangle in the cache is left) - the best score first, then the first triangle. An entry is stale if the score of the triangle has changed since, the triangle is pushed again with the new score
+        std::priority_queue<Candidate> candidates;
+        for(unsigned int t = 0; t < triangle_count; t++) {
+            triangle_scores[t] = triangleScore(indices, vertex_scores, t);
+            candidates.push({triangle_scores[t], t});
+        }
+
+        std::vector<unsigned int> cache, next_cache;
+        std::vector<unsigned int> reordered;
+        reordered.reserve(indices.size());
+
+        int best = -1;
+        for(unsigned int output = 0; output < triangle_count; output++) {
+            if(best < 0) { // no triangle in the cache - the best of the rest (only at the start and after an isolated part of the mesh)
+                while(added[candidates.top().triangle] || candidates.top().score != triangle_scores[candidates.top().triangle]) candidates.pop();
+                best = (int)candidates.top().triangle;
+                candidates.pop();
+            }
+
+            unsigned int triangle = (unsigned int)best;
+            added[triangle] = true;
+            next_cache.clear();
+            for(unsigned int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * triangle + k];
+                reordered.push_back(v);
+                if(std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) next_cache.push_back(v);
+
+                // remove the triangle from the list of the vertex
+                unsigned int* list = &vertex_triangles[first[v]];
+                for(unsigned int i = 0; i < remaining[v]; i++) {
+                    if(list[i] == triangle) {
+                        std::swap(list[i], list[remaining[v] - 1]);
+                        break;
+                    }
+                }
+                remaining[v]--;
+            }
+            // the vertices of the triangle go to the front of the cache
+            unsigned int added_count = (unsigned int)next_cache.size();
+            for(unsigned int v : cache) {
+                if(std::find(next_cache.begin(), next_cache.begin() + added_count, v) == next_cache.begin() + added_count) next_cache.push_back(v);
+            }
+            // the vertices pushed out of the cache lose the cache score, and so do their triangles
+            for(unsigned int i = VERTEX_CACHE_SIZE; i < next_cache.size(); i++) {
+                unsigned int v = next_cache[i];
+                vertex_scores[v] = vertexScore(-1, remaining[v]);
+                for(unsigned int j = 0; j < remaining[v]; j++) {
+                    unsigned int t = vertex_triangles[first[v] + j];
+                    triangle_scores[t] = triangleScore(indices, vertex_scores, t);
+                    candidates.push({triangle_scores[t], t});
+                }
+            }
+            if(next_cache.size() > VERTEX_CACHE_SIZE) next_cache.resize(VERTEX_CACHE_SIZE);
+            cache.swap(next_cache);
+
+            // update the scores of the vertices in the cache and of their triangles, pick the best of them
+            for(unsigned int i = 0; i < cache.size(); i++) {
+                vertex_scores[cache[i]] = vertexScore((int)i, remaining[cache[i]]);
+            }
+            best = -1;
+            float best_score = -1.0f;
+            for(unsigned int v : cache) {
+                for(unsigned int i = 0; i < remaining[v]; i++) {
+                    unsigned int t = vertex_triangles[first[v] + i];
+                    triangle_scores[t] = triangleScore(indices, vertex_scores, t);
+                    if(triangle_scores[t] > best_score) {
+                        best_score = triangle_scores[t];
+                        best = (int)t;
+                    }
+                }
+            }
+        }
+        indices.swap(reordered);
+    }
+
+    // number the vertices in the order of their first use
+    static void reorderVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+        const unsigned int unused = 0xffffffffu;
+        std::vector<unsigned int> remap(vertices.size(), unused);
+        std::vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for(unsigned int& index : indices) {
+            if(remap[index] == unused) {
+                remap[index] = (unsigned int)reordered.size();
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(reordered); // the vertices not used by any triangle are dropped
+    }
+
+public:
+    // reorder the triangles of a part of the mesh on its own (e.g. a level of detail, see "mesh_simplifier.h")
+    static void reorderForCache(std::vector<unsigned int>& indices, unsigned int vertex_count) {
+        reorderTriangles(indices, vertex_count);
+    }
+
+    // average number of the vertices transformed per triangle with a FIFO post-transform cache
+    static float acmr(const std::vector<unsigned int>& indices, unsigned int vertex_count, unsigned int cache_size = VERTEX_CACHE_SIZE) {
+        if(indices.size() < 3) return 0.0f;
+        std::vector<unsigned int> stamp(vertex_count, 0); // time at which the vertex entered the cache, 0 - not in the cache
+        unsigned int misses = 0;
+        for(unsigned int index : indices) {
+            if(stamp[index] == 0 || misses - stamp[index] >= cache_size) {
+                misses++;
+                stamp[index] = misses;
+            }
+        }
+        return misses / float(indices.size() / 3);
+    }
+
+    static void optimize(MeshData& mesh, const std::string& name) {
+        if(mesh.vertices.empty() || mesh.indices.empty()) return;
+        unsigned int vertices_before = (unsigned int)mesh.vertices.size();
+        float acmr_before = acmr(mesh.indices, vertices_before);
+
+        weld(mesh.vertices, mesh.indices);
+        reorderTriangles(mesh.indices, (unsigned int)mesh.vertices.size());
+        reorderVertices(mesh.vertices, mesh.indices);
+        mesh.own();
+
+        // one string, so the lines of the worker threads do not mix
+        std::ostringstream log;
+        log << "MESH_OPTIMIZER: " << name << ": " << vertices_before << " -> " << mesh.vertices.size() << " vertices, ACMR " << acmr_before << " -> " << acmr(mesh.indices, (unsigned int)mesh.vertices.size()) << (mesh.vertices.size() <= 65536 ? ", 16-bit indices" : "") << "\n";
+        std::cout << log.str() << std::flush;
+    }
+};
+
+#endif /* mesh_optimizer_h */
@@ -0,0 +1,375 @@
+//
+//  mesh_simplifier.h
+//  Special Relativity
+//
+//  Levels of detail of the meshes, made once when a model is imported (they are stored in the cache with the mesh, see "mesh_cache.h"). Every vertex of a relativistic object runs the solver of the light cone equation, so a detailed model far from the camera, which covers a few pixels, costs as much as one next to it - the scene draws it with a simpler level instead (see "Scene::selectLevels").
+//  The edges are collapsed in the order of the smallest quadric error (Garland, Heckbert, "Surface Simplification Using Quadric Error Metrics") - the error of a vertex is the mean squared distance to the planes of the original triangles merged into it. A vertex is moved onto one of its neighbours (half-edge collapse), so the levels reuse the vertex buffer of the mesh and only add their own indices. The vertices with the same position but different normals or texture coordinates (seams) are collapsed together and only along the seam, the borders of open meshes are kept by additional planes. The meshes in which every face has its own texture coordinates or normals (e.g. "sphere.obj") cannot be simplified without changing their look, so they keep only the full level.
+//  The levels follow the full mesh in the index array, every level has about MESH_LOD_RATIO of the triangles of the previous one.
+//
+//  *** "MeshSimplifier::buildLevels(mesh, name)":
+//  - appends the levels of detail to the indices of the mesh (optimised for the post-transform cache, see "mesh_optimizer.h") and prints the number of the triangles and the vertices of every level.
+//
+
+#ifndef mesh_simplifier_h
+#define mesh_simplifier_h
+
+#include "glm.hpp"
+
+#include "mesh.h"
+#include "hash.h"
+#include "mesh_optimizer.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+
+// the largest number of levels of a mesh (with the full mesh)
+const unsigned int MESH_LOD_MAX_LEVELS = 5;
+// a level has about this part of the triangles of the previous one
+const float MESH_LOD_RATIO = 0.5f;
+// no level has fewer triangles
+const unsigned int MESH_LOD_MIN_TRIANGLES = 16;
+// the simplification stops when the error reaches this part of the size of the mesh
+const float MESH_LOD_MAX_ERROR = 0.1f;
+// weight of the planes keeping the borders of open meshes
+const float MESH_LOD_BORDER_WEIGHT = 10.0f;
+
+class MeshSimplifier {
+private:
+    // sum of the squared distances to the planes (weighted by their area), as a symmetric 4x4 matrix
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+        double weight = 0;
+
+        void addPlane(const glm::vec3& normal, float distance, float plane_weight) {
+            double a = normal.x, b = normal.y, c = normal.z, d = distance, w = plane_weight;
+            a00 += w*a*a; a01 += w*a*b; a02 += w*a*c; a03 += w*a*d;
+            a11 += w*b*b; a12 += w*b*c; a13 += w*b*d;
+            a22 += w*c*c; a23 += w*c*d;
+            a33 += w*d*d;
+            weight += w;
+        }
+
+        void add(const Quadric& other) {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+            a11 += other.a11; a12 += other.a12; a13 += other.a13;
+            a22 += other.a22; a23 += other.a23;
+            a33 += other.a33;
+            weight += other.weight;
+        }
+
+        // mean squared distance of the point to the planes
+        double error(const glm::vec3& point) const {
+            double x = point.x, y = point.y, z = point.z;
+            double sum = a00*x*x + a11*y*y + a22*z*z + 2.0*(a01*x*y + a02*x*z + a12*y*z) + 2.0*(a03*x + a13*y + a23*z) + a33;
+            return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+        }
+    };
+
+    // move the point "from" onto the point "to"
+    struct Collapse {
+        double error;
+        unsigned int from, to;
+        unsigned int from_version, to_version; // the collapse is outdated if any of the points has changed since
+
+        bool operator<(const Collapse& other) const {
+            return error > other.error; // the smallest error on the top of the queue
+        }
+    };
+
+    // the state of the simplified mesh, the points are the distinct positions of the vertices
+    struct State {
+        std::vector<glm::vec3> positions; // of the points
+        std::vector<unsigned int> point_of; // of every vertex
+        std::vector<std::vector<unsigned int>> point_triangles; // may hold the removed triangles, they are skipped
+        std::vector<Quadric> quadrics;
+        std::vector<unsigned int> versions;
+        std::vector<bool> removed_points;
+
+        std::vector<unsigned int> indices; // vertices of the triangles
+        std::vector<bool> removed_triangles;
+        unsigned int triangle_count = 0;
+
+        std::priority_queue<Collapse> queue;
+    };
+
+    struct PositionHash {
+        size_t operator()(const glm::vec3& position) const {
+            return (size_t)fnv1a(&position, sizeof(glm::vec3));
+        }
+    };
+
+    struct PositionEqual {
+        bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+            return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+        }
+    };
+
+    static inline std::uint64_t edgeKey(unsigned int a, unsigned int b) {
+        return a < b ? ((std::uint64_t)a << 32) | b : ((std::uint64_t)b << 32) | a;
+    }
+
+    static void setUp(const MeshData& mesh, State& state) {
+        std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> points;
+        state.point_of.resize(mesh.vertex_count);
+        for(unsigned int v = 0; v < mesh.vertex_count; v++) {
+            std::pair<std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual>::iterator, bool> it = points.insert(std::make_pair(mesh.vertex_data[v].Position, (unsigned int)state.positions.size()));
+            if(it.second) state.positions.push_back(mesh.vertex_data[v].Position);
+            state.point_of[v] = it.first->second;
+        }
+        unsigned int point_count = (unsigned int)state.positions.size();
+        state.point_triangles.resize(point_count);
+        state.quadrics.resize(point_count);
+        state.versions.assign(point_count, 0);
+        state.removed_points.assign(point_count, false);
+
+        state.indices.assign(mesh.index_data, mesh.index_data + mesh.index_count);
+        state.triangle_count = mesh.index_count / 3;
+        state.removed_triangles.assign(state.triangle_count, false);
+
+        // the planes of the triangles, the edges used by one triangle are the borders
+        std::unordered_map<std::uint64_t, int> edge_triangles; // the triangle of the edge, -1 if it has more
+        for(unsigned int t = 0; t < state.removed_triangles.size(); t++) {
+            unsigned int p[3];
+            for(unsigned int k = 0; k < 3; k++) p[k] = state.point_of[state.indices[3 * t + k]];
+            if(p[0] == p[1] || p[1] == p[2] || p[2] == p[0]) {
+                state.removed_triangles[t] = true;
+                state.triangle_count--;
+                continue;
+            }
+            glm::vec3 normal = glm::cross(state.positions[p[1]] - state.positions[p[0]], state.positions[p[2]] - state.positions[p[0]]);
+            float length = glm::length(normal);
+            for(unsigned int k = 0; k < 3; k++) {
+                state.point_triangles[p[k]].push_back(t);
+                if(length > 0.0f) state.quadrics[p[k]].addPlane(normal / length, -glm::dot(normal / length, state.positions[p[0]]), 0.5f * length);
+
+                std::pair<std::unordered_map<std::uint64_t, int>::iterator, bool> it = edge_triangles.insert(std::make_pair(edgeKey(p[k], p[(k + 1) % 3]), (int)t));
+                if(!it.second) it.first->second = -1;
+            }
+        }
+        for(const std::pair<const std::uint64_t, int>& edge : edge_triangles) {
+            if(edge.second < 0) continue;
+            unsigned int a = (unsigned int)(edge.first >> 32), b = (unsigned int)(edge.first & 0xffffffffu);
+            const unsigned int* triangle = &state.indices[3 * edge.second];
+            glm::vec3 normal = glm::cross(state.positions[state.point_of[triangle[1]]] - state.positions[state.point_of[triangle[0]]], state.positions[state.point_of[triangle[2]]] - state.positions[state.point_of[triangle[0]]]);
+            glm::vec3 side = glm::cross(state.positions[b] - state.positions[a], normal);
+            float length = glm::length(side);
+            if(length == 0.0f) continue;
+            side /= length;
+            float edge_length = glm::length(state.positions[b] - state.positions[a]);
+            for(unsigned int p : {a, b}) state.quadrics[p].addPlane(side, -glm::dot(side, state.positions[a]), MESH_LOD_BORDER_WEIGHT * edge_length * edge_length);
+        }
+
+        for(unsigned int t = 0; t < state.removed_triangles.size(); t++) {
+            if(state.removed_triangles[t]) continue;
+            for(unsigned int k = 0; k < 3; k++) {
+                unsigned int a = state.point_of[state.indices[3 * t + k]], b = state.point_of[state.indices[3 * t + (k + 1) % 3]];
+                if(a < b) { // every edge of a closed mesh once
+                    push(state, a, b);
+                    push(state, b, a);
+                }
+            }
+        }
+    }
+
+    static void push(State& state, unsigned int from, unsigned int to) {
+        Quadric quadric = state.quadrics[from];
+        quadric.add(state.quadrics[to]);
+        state.queue.push({quadric.error(state.positions[to]), from, to, state.versions[from], state.versions[to]});
+    }
+
+    // the neighbours of the point, "shared" - the triangles with both points
+    static void neighbours(const State& state, unsigned int point, std::vector<unsigned int>& result) {
+        result.clear();
+        for(unsigned int t : state.point_triangles[point]) {
+            if(state.removed_triangles[t]) continue;
+            for(unsigned int k = 0; k < 3; k++) {
+                unsigned int p = state.point_of[state.indices[3 * t + k]];
+                if(p != point && std::find(result.begin(), result.end(), p) == result.end()) result.push_back(p);
+            }
+        }
+    }
+
+    // every vertex of "from" has to be replaced by a vertex of "to" with the same attributes - one connected to it by an edge
+    static bool mapVertices(const State& state, unsigned int from, unsigned int to, std::vector<std::pair<unsigned int, unsigned int>>& mapping) {
+        mapping.clear();
+        for(unsigned int t : state.point_triangles[from]) {
+            if(state.removed_triangles[t]) continue;
+            const unsigned int* triangle = &state.indices[3 * t];
+            for(unsigned int k = 0; k < 3; k++) {
+                if(state.point_of[triangle[k]] != from) continue;
+                unsigned int vertex = triangle[k];
+                bool mapped = false;
+                for(const std::pair<unsigned int, unsigned int>& pair : mapping) mapped = mapped || pair.first == vertex;
+                if(mapped) continue;
+                for(unsigned int j = 0; j < 3; j++) {
+                    if(state.point_of[triangle[j]] == to) mapping.push_back(std::make_pair(vertex, triangle[j]));
+                }
+            }
+        }
+        // the vertices used by no triangle shared with "to" - the collapse would cross a seam
+        for(unsigned int t : state.point_triangles[from]) {
+            if(state.removed_triangles[t]) continue;
+            for(unsigned int k = 0; k < 3; k++) {
+                unsigned int vertex = state.indices[3 * t + k];
+                if(state.point_of[vertex] != from) continue;
+                bool mapped = false;
+                for(const std::pair<unsigned int, unsigned int>& pair : mapping) mapped = mapped || pair.first == vertex;
+                if(!mapped) return false;
+            }
+        }
+        return true;
+    }
+
+    static bool collapse(State& state, const Collapse& candidate, std::vector<unsigned int>& from_neighbours, std::vector<unsigned int>& to_neighbours, std::vector<std::pair<unsigned int, unsigned int>>& mapping) {
+        unsigned int from = candidate.from, to = candidate.to;
+
+        // the link condition - the points can share only the neighbours of their common triangles, otherwise the surface is pinched
+        neighbours(state, from, from_neighbours);
+        neighbours(state, to, to_neighbours);
+        unsigned int common = 0, shared = 0;
+        for(unsigned int p : from_neighbours) if(std::find(to_neighbours.begin(), to_neighbours.end(), p) != to_neighbours.end()) common++;
+        for(unsigned int t : state.point_triangles[from]) {
+            if(state.removed_triangles[t]) continue;
+            for(unsigned int k = 0; k < 3; k++) if(state.point_of[state.indices[3 * t + k]] == to) shared++;
+        }
+        if(shared == 0 || common > shared) return false;
+
+        // no triangle can be flipped
+        for(unsigned int t : state.point_triangles[from]) {
+            if(state.removed_triangles[t]) continue;
+            glm::vec3 before[3], after[3];
+            bool degenerate = false;
+            for(unsigned int k = 0; k < 3; k++) {
+                unsigned int p = state.point_of[state.indices[3 * t + k]];
+                degenerate = degenerate || p == to;
+                before[k] = state.positions[p];
+                after[k] = p == from ? state.positions[to] : before[k];
+            }
+            if(degenerate) continue;
+            glm::vec3 normal_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if(glm::dot(normal_before, normal_after) <= 0.0f) return false;
+        }
+
+        if(!mapVertices(state, from, to, mapping)) return false;
+
+        for(unsigned int t : state.point_triangles[from]) {
+            if(state.removed_triangles[t]) continue;
+            bool degenerate = false;
+            for(unsigned int k = 0; k < 3; k++) {
+                unsigned int& vertex = state.indices[3 * t + k];
+                if(state.point_of[vertex] == to) degenerate = true;
+                for(const std::pair<unsigned int, unsigned int>& pair : mapping) {
+                    if(pair.first == vertex) {
+                        vertex = pair.second;
+                        break;
+                    }
+                }
+            }
+            if(degenerate) {
+                state.removed_triangles[t] = true;
+                state.triangle_count--;
+            } else state.point_triangles[to].push_back(t);
+        }
+        state.point_triangles[from].clear();
+        state.removed_points[from] = true;
+        state.quadrics[to].add(state.quadrics[from]);
+        state.versions[to]++;
+
+        // the removed triangles are dropped from the list, the new collapses of "to" replace the outdated ones
+        std::vector<unsigned int>& triangles = state.point_triangles[to];
+        triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [&state](unsigned int t) { return (bool)state.removed_triangles[t]; }), triangles.end());
+        neighbours(state, to, to_neighbours);
+        for(unsigned int p : to_neighbours) {
+            push(state, to, p);
+            push(state, p, to);
+        }
+        return true;
+    }
+
+    // collapse the edges until the mesh has at most "target" triangles, returns the largest error of the collapses (squared distance)
+    static double simplify(State& state, unsigned int target, double max_error, double error) {
+        std::vector<unsigned int> from_neighbours, to_neighbours;
+        std::vector<std::pair<unsigned int, unsigned int>> mapping;
+        while(state.triangle_count > target && !state.queue.empty()) {
+            Collapse candidate = state.queue.top();
+            if(candidate.error > max_error) break;
+            state.queue.pop();
+            if(state.removed_points[candidate.from] || state.removed_points[candidate.to]) continue;
+            if(candidate.from_version != state.versions[candidate.from] || candidate.to_version != state.versions[candidate.to]) continue;
+            if(collapse(state, candidate, from_neighbours, to_neighbours, mapping)) error = std::max(error, candidate.error);
+        }
+        return error;
+    }
+
+    static unsigned int usedVertices(const std::vector<unsigned int>& indices, unsigned int vertex_count) {
+        std::vector<bool> used(vertex_count, false);
+        unsigned int count = 0;
+        for(unsigned int index : indices) {
+            if(!used[index]) count++;
+            used[index] = true;
+        }
+        return count;
+    }
+
+public:
+    static void buildLevels(MeshData& mesh, const std::string& name) {
+        mesh.lods.clear();
+        mesh.lods.push_back({0, mesh.index_count, usedVertices(std::vector<unsigned int>(mesh.index_data, mesh.index_data + mesh.index_count), mesh.vertex_count), 0.0f});
+        if(mesh.index_count / 3 < 2 * MESH_LOD_MIN_TRIANGLES) return;
+
+        State state;
+        setUp(mesh, state);
+        glm::vec3 min(INFINITY), max(-INFINITY);
+        for(const glm::vec3& position : state.positions) {
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+        double max_error = (double)MESH_LOD_MAX_ERROR * glm::length(max - min);
+        max_error *= max_error;
+
+        std::vector<unsigned int> indices(mesh.index_data, mesh.index_data + mesh.index_count);
+        std::ostringstream log;
+        log << "MESH_SIMPLIFIER: " << name << ": " << mesh.index_count / 3 << " triangles (" << mesh.lods[0].vertex_count << " vertices)";
+
+        double error = 0.0;
+        while(mesh.lods.size() < MESH_LOD_MAX_LEVELS) {
+            unsigned int previous = mesh.lods.back().index_count / 3;
+            unsigned int target = std::max((unsigned int)(previous * MESH_LOD_RATIO), MESH_LOD_MIN_TRIANGLES);
+            error = simplify(state, target, max_error, error);
+            // a level which is hardly simpler than the previous one is not worth a switch
+            if(state.triangle_count > previous - (previous - target) / 2) break;
+
+            std::vector<unsigned int> level;
+            level.reserve(3 * state.triangle_count);
+            for(unsigned int t = 0; t < state.removed_triangles.size(); t++) {
+                if(!state.removed_triangles[t]) level.insert(level.end(), &state.indices[3 * t], &state.indices[3 * t + 3]);
+            }
+            MeshOptimizer::reorderForCache(level, mesh.vertex_count);
+
+            mesh.lods.push_back({(unsigned int)indices.size(), (unsigned int)level.size(), usedVertices(level, mesh.vertex_count), (float)std::sqrt(error)});
+            indices.insert(indices.end(), level.begin(), level.end());
+            log << " -> " << level.size() / 3 << " (" << mesh.lods.back().vertex_count << ")";
+            if(state.triangle_count <= MESH_LOD_MIN_TRIANGLES) break;
+        }
+        if(mesh.lods.size() == 1) return;
+
+        // the vertices stay where they are, only the indices of the levels are added
+        if(mesh.vertices.empty()) mesh.vertices.assign(mesh.vertex_data, mesh.vertex_data + mesh.vertex_count);
+        mesh.indices.swap(indices);
+        mesh.own();
+
+        log << "\n";
+        std::cout << log.str() << std::flush;
+    }
+};
+
+#endif /* mesh_simplifier_h */
@@ -19,6 +19,10 @@
 
 #include "mesh.h"
 #include "shader.h"
+#include "mesh_cache.h"
+#include "texture_registry.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
 
 #include <string>
 #include <fstream>
@@ -26,7 +30,44 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
 
+// image decoded by stb_image, it can be decoded on any thread and uploaded later on the thread of the OpenGL context
+struct Image {
+    int width = 0, height = 0, components = 0;
+    unsigned char* data = nullptr;
+    
+    Image() {}
+    Image(const Image&) = delete;
+    Image& operator=(const Image&) = delete;
+    
+    ~Image() {
+        if(data) stbi_image_free(data);
+    }
+    
+    // the format of the pixels, also used as the internal format of the texture
+    inline GLenum format() const {
+        if(components == 1) return GL_RED;
+        else if(components == 3) return GL_RGB;
+        return GL_RGBA;
+    }
+};
+
+// everything needed to create a model, prepared without OpenGL (see "Model::import")
+struct ModelData {
+    std::string directory;
+    float bounding_radius = 0.0f;
+    std::vector<MeshData> meshes;
+    std::unique_ptr<MeshCache> cache; // the arrays of the meshes point to the mapped cache file if it was used
+};
+
+void decodeImage(const std::string& filename, Image& image);
+void uploadImage(unsigned int textureID, const Image& image);
 unsigned int TextureFromFile(const char* path, const std::string &directory);
 
 class Model {
@@ -34,44 +75,161 @@ public:
     std::vector<Texture> textures_loaded;
     std::vector<Mesh> meshes;
     std::string directory;
+    float bounding_radius = 0.0f; // distance of the furthest vertex from the origin of the model
+    std::vector<float> lod_errors; // for every level of detail
+    std::vector<unsigned int> lod_vertex_counts;
+    
+    // the model is empty until "upload" is called
+    Model() {}
     
-    Model(std::string const &path) {
-        loadModel(path);
+    Model(std::string const &path, const VertexFormat& format = VertexFormat()) {
+        upload(import(path, format), [this](const std::string& file) { return TextureFromFile(file.c_str(), directory); }, format);
     }
     
-    void draw(Shader shader) {
-        for(unsigned int i = 0; i < meshes.size(); i++) {
-            meshes[i].draw(shader);
+    // the meshes own their buffers, so the model can only be moved (share it through "ModelRegistry")
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    
+    Model(Model&& other) noexcept : textures_loaded(std::move(other.textures_loaded)), meshes(std::move(other.meshes)), directory(std::move(other.directory)), bounding_radius(other.bounding_radius), lod_errors(std::move(other.lod_errors)), lod_vertex_counts(std::move(other.lod_vertex_counts)) {
+        other.textures_loaded.clear();
+    }
+    
+    Model& operator=(Model&& other) noexcept {
+        if(this != &other) {
+            releaseTextures();
+            textures_loaded = std::move(other.textures_loaded);
+            meshes = std::move(other.meshes);
+            directory = std::move(other.directory);
+            bounding_radius = other.bounding_radius;
+            lod_errors = std::move(other.lod_errors);
+            lod_vertex_counts = std::move(other.lod_vertex_counts);
+            other.textures_loaded.clear();
         }
+        return *this;
     }
     
-private:
-    void loadModel(std::string const &path) {
+    ~Model() {
+        releaseTextures();
+    }
+    
+    // read the model from the cache or the file - no OpenGL calls, so it can run on a worker thread (see "model_loader.h"). The meshes are packed in "format" (see "MeshData::pack"), the tangents are calculated only if the format has them.
+    static ModelData import(std::string const &path, const VertexFormat& format = VertexFormat()) {
+        ModelData data;
+        data.directory = path.substr(0, path.find_last_of('/'));
+        
+        MeshCache cache = MeshCache::load(path, format);
+        if(cache.isValid()) {
+            loadCache(cache, data);
+            data.cache.reset(new MeshCache(std::move(cache)));
+            resolveTextures(data);
+            return data;
+        }
+        
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | (format.needsTangents() ? aiProcess_CalcTangentSpace : 0));
         
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
             std::cout << "ERROR::ASSIMP: " << importer.GetErrorString() << std::endl;
-            return;
+            return data;
+        }
+        processNode(scene->mRootNode, scene, data);
+        for(unsigned int i = 0; i < data.meshes.size(); i++) {
+            MeshOptimizer::optimize(data.meshes[i], path + " (mesh " + std::to_string(i) + ")");
+            MeshSimplifier::buildLevels(data.meshes[i], path + " (mesh " + std::to_string(i) + ")");
+            data.meshes[i].pack(format);
+        }
+        
+        MeshCache::save(path, data.meshes, data.bounding_radius, format);
+        resolveTextures(data);
+        return data;
+    }
+    
+    // create the meshes on the thread of the OpenGL context, "create_texture" returns the texture of a file in the directory of the model (it is called only for the files which no model has loaded before, see "texture_registry.h")
+    // "format" has to be the one the model was imported with (see "vertex_format.h")
+    void upload(const ModelData& data, const std::function<unsigned int(const std::string&)>& create_texture, const VertexFormat& format = VertexFormat()) {
+        directory = data.directory;
+        bounding_radius = data.bounding_radius;
+        std::unordered_map<std::string, unsigned int> loaded; // index in "textures_loaded" by the path
+        for(const MeshData& mesh : data.meshes) {
+            std::vector<Texture> textures;
+            for(const TextureReference& reference : mesh.textures) textures.push_back(loadTexture(reference, loaded, create_texture));
+            meshes.push_back(Mesh(mesh, textures, format));
+        }
+        
+        // a level of the model uses the same level of every mesh (or the simplest one the mesh has)
+        unsigned int level_count = 0;
+        for(const Mesh& mesh : meshes) level_count = std::max(level_count, (unsigned int)mesh.lods.size());
+        lod_errors.assign(level_count, 0.0f);
+        lod_vertex_counts.assign(level_count, 0);
+        for(unsigned int level = 0; level < level_count; level++) {
+            for(const Mesh& mesh : meshes) {
+                const MeshLOD& lod = mesh.lods[std::min<size_t>(level, mesh.lods.size() - 1)];
+                lod_errors[level] = std::max(lod_errors[level], lod.error);
+                lod_vertex_counts[level] += lod.vertex_count;
+            }
+        }
+    }
+    
+    // number of the levels of detail of the model (see "mesh_simplifier.h"), at least 1 after the model is uploaded
+    inline unsigned int lodCount() const {
+        return (unsigned int)lod_errors.size();
+    }
+    
+    // how far the surface of the level can be from the full model
+    inline float lodError(unsigned int level) const {
+        return level < lod_errors.size() ? lod_errors[level] : 0.0f;
+    }
+    
+    // number of the vertices transformed when the level is drawn
+    inline unsigned int lodVertexCount(unsigned int level) const {
+        return level < lod_vertex_counts.size() ? lod_vertex_counts[level] : 0;
+    }
+    
+    void draw(const Shader& shader) {
+        for(unsigned int i = 0; i < meshes.size(); i++) {
+            meshes[i].draw(shader);
         }
-        directory = path.substr(0, path.find_last_of('/'));
-        processNode(scene->mRootNode, scene);
     }
     
-    void processNode(aiNode* node, const aiScene* scene) {
+private:
+    // the textures can be shared with other models (see "texture_registry.h")
+    void releaseTextures() {
+        for(const Texture& texture : textures_loaded) TextureRegistry::release(texture.ID);
+        textures_loaded.clear();
+    }
+    
+    // the buffers point to the mapped cache file, the meshes have no CPU arrays
+    static void loadCache(const MeshCache& cache, ModelData& data) {
+        data.bounding_radius = cache.boundingRadius();
+        for(unsigned int i = 0; i < cache.meshCount(); i++) {
+            MeshData mesh;
+            mesh.vertex_buffer = cache.vertexBuffer(i);
+            mesh.vertex_count = cache.vertexCount(i);
+            mesh.index_buffer = cache.indexBuffer(i);
+            mesh.index_size = cache.indexSize(i);
+            mesh.index_count = cache.indexCount(i);
+            mesh.textures = cache.textures(i);
+            mesh.lods = cache.lods(i);
+            data.meshes.push_back(std::move(mesh));
+        }
+    }
+    
+    static void processNode(aiNode* node, const aiScene* scene, ModelData& data) {
         for(unsigned int i = 0; i < node->mNumMeshes; i++) {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            data.meshes.push_back(processMesh(mesh, scene, data.bounding_radius));
+            data.meshes.back().own(); // moving the vectors keeps their arrays, so the pointers stay valid
         }
         for(unsigned int i = 0; i < node->mNumChildren; i++) {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, data);
         }
     }
     
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene) {
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-        std::vector<Texture> textures;
+    static MeshData processMesh(aiMesh* mesh, const aiScene* scene, float& bounding_radius) {
+        MeshData data;
+        std::vector<Vertex>& vertices = data.vertices;
+        std::vector<unsigned int>& indices = data.indices;
+        std::vector<TextureReference>& textures = data.textures;
         
         for(unsigned int i = 0; i < mesh->mNumVertices; i++) {
             Vertex vertex;
@@ -80,6 +238,7 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            bounding_radius = glm::max(bounding_radius, glm::length(vector));
             
             vector.x = mesh->mNormals[i].x;
             vector.y = mesh->mNormals[i].y;
@@ -127,46 +286,88 @@ private:
         // specular: texture_specularN
         // normal: texture_normalN
         
-        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        std::vector<TextureReference> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        std::vector<TextureReference> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<TextureReference> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<TextureReference> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        return Mesh(vertices, indices, textures);
+        return data;
     }
     
-    std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
-        std::vector<Texture> textures;
+    static std::vector<TextureReference> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
+        std::vector<TextureReference> textures;
         
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++) {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true;
-                    break;
+            TextureReference reference;
+            reference.type = typeName;
+            reference.path = str.C_Str();
+            textures.push_back(reference);
+        }
+        return textures;
+    }
+    
+    // find the files of the textures, the hashes of their content and their sizes (every file is read once)
+    static void resolveTextures(ModelData& data) {
+        std::unordered_map<std::string, TextureReference> resolved; // by the path relative to the directory
+        for(MeshData& mesh : data.meshes) {
+            for(TextureReference& reference : mesh.textures) {
+                std::unordered_map<std::string, TextureReference>::iterator it = resolved.find(reference.path);
+                if(it == resolved.end()) {
+                    TextureReference file;
+                    std::string filename = data.directory + '/' + reference.path;
+                    char real_path[PATH_MAX];
+                    file.file = realpath(filename.c_str(), real_path) ? std::string(real_path) : filename;
+                    file.hash = MeshCache::hashFile(file.file);
+                    int width, height, nrComponents;
+                    if(stbi_info(file.file.c_str(), &width, &height, &nrComponents)) file.bytes = (size_t)width * height * nrComponents * 4 / 3; // 4/3 - with the mipmaps
+                    it = resolved.insert(std::make_pair(reference.path, file)).first;
                 }
-            }
-            if(!skip) {
-                Texture texture;
-                texture.ID = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);
+                reference.file = it->second.file;
+                reference.hash = it->second.hash;
+                reference.bytes = it->second.bytes;
             }
         }
-        return textures;
+    }
+    
+    Texture loadTexture(const TextureReference& reference, std::unordered_map<std::string, unsigned int>& loaded, const std::function<unsigned int(const std::string&)>& create_texture) {
+        // check if texture was loaded before and if so, skip loading a new texture
+        std::unordered_map<std::string, unsigned int>::const_iterator it = loaded.find(reference.path);
+        if(it != loaded.end()) return textures_loaded[it->second];
+        
+        Texture texture;
+        texture.ID = TextureRegistry::acquire(reference, [&]() { return create_texture(reference.path); });
+        texture.type = reference.type;
+        texture.path = reference.path;
+        loaded[reference.path] = (unsigned int)textures_loaded.size();
+        textures_loaded.push_back(texture);
+        return texture;
     }
 };
 
+void decodeImage(const std::string& filename, Image& image) {
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, 0);
+    if(!image.data) std::cout << "ERROR::STBI: Texture failed to load at path: " << filename << std::endl;
+}
+
+void uploadImage(unsigned int textureID, const Image& image) {
+    if(!image.data) return;
+    
+    GLState::bindTexture(0, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, image.format(), image.width, image.height, 0, image.format(), GL_UNSIGNED_BYTE, image.data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
 unsigned int TextureFromFile(const char* path, const std::string &directory) {
     std::string filename = std::string(path);
     filename = directory + '/' + filename;
@@ -174,28 +375,9 @@ unsigned int TextureFromFile(const char* path, const std::string &directory) {
     unsigned int textureID;
     glGenTextures(1, &textureID);
     
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if(data) {
-        GLenum format;
-        if(nrComponents == 1) format = GL_RED;
-        else if(nrComponents == 3) format = GL_RGB;
-        else format = GL_RGBA;
-        
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        
-        stbi_image_free(data);
-    } else {
-        std::cout << "ERROR::STBI: Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    Image image;
+    decodeImage(filename, image);
+    uploadImage(textureID, image);
     
     return textureID;
 }
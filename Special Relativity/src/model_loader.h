@@ -0,0 +1,91 @@
+//
+//  model_loader.h
+//  Special Relativity
+//
+//  Loads the models of the scene in parallel. The import of the files (Assimp or the cache, building the vertices) runs on the worker threads of a "ThreadPool". The finished meshes are handed to the thread of the OpenGL context through a queue, where the buffers are created. The textures are requested from a "TextureStreamer" - the models are ready before their images are (see "texture_streamer.h").
+//
+//  *** "load(path, model, format)":
+//  - starts loading the model at "path" into "model" with the vertex format of its shader (see "vertex_format.h") - the model stays empty until the uploads are processed, it cannot be moved or deleted before.
+//
+//  *** "finish()":
+//  - processes the uploads on the calling thread (the one owning the OpenGL context) until all the started models are loaded.
+//
+
+#ifndef model_loader_h
+#define model_loader_h
+
+#include <glad/glad.h>
+
+#include "model.h"
+#include "thread_pool.h"
+#include "texture_streamer.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class ModelLoader {
+private:
+    std::mutex mutex;
+    std::condition_variable upload_added;
+    std::deque<std::function<void()>> uploads; // run on the thread of the OpenGL context
+    unsigned int pending = 0; // models which have not been uploaded yet
+
+    TextureStreamer& textures;
+
+    ThreadPool pool; // destroyed first - the tasks left in it still post to the queue
+
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending++;
+    }
+
+    void done() {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending--;
+    }
+
+    void post(std::function<void()> upload) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uploads.push_back(std::move(upload));
+        }
+        upload_added.notify_one();
+    }
+
+public:
+    ModelLoader(TextureStreamer& textures) : textures(textures) {}
+
+    ModelLoader(const ModelLoader&) = delete;
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    void load(const std::string& path, Model& model, const VertexFormat& format = VertexFormat()) {
+        start();
+        pool.enqueue([this, path, &model, format]() {
+            std::shared_ptr<ModelData> data = std::make_shared<ModelData>(Model::import(path, format));
+            post([this, data, &model, format]() {
+                model.upload(*data, [this, &data](const std::string& file) { return textures.request(data->directory + '/' + file); }, format);
+                done();
+            });
+        });
+    }
+
+    void finish() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(pending > 0) {
+            upload_added.wait(lock, [this]() { return !uploads.empty(); });
+            std::function<void()> upload = std::move(uploads.front());
+            uploads.pop_front();
+
+            lock.unlock();
+            upload();
+            lock.lock();
+        }
+    }
+};
+
+#endif /* model_loader_h */
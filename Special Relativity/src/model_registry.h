@@ -0,0 +1,173 @@
+//
+//  model_registry.h
+//  Special Relativity
+//
+//  Owns all the models of the program, so every file is loaded once - the scenes get lightweight handles to the models, the same path (resolved) and vertex format give the same model with the same GPU buffers. The handles are reference counted. The registry outlives the scenes: a model whose last handle is gone stays loaded, so a scene built again (e.g. after switching the scenario) reuses it instead of importing it again, until "releaseUnused()" deletes it.
+//  The models are loaded by a "ModelLoader" and their textures streamed by a "TextureStreamer", both owned by the registry.
+//
+//  *** "acquire(path, format)":
+//  - returns a handle to the model at "path" with the vertices in "format" (see "vertex_format.h"), starts loading it if it is not loaded yet. The model is empty until "finish()" is called.
+//
+//  *** "releaseUnused()":
+//  - deletes the models without handles (their buffers and the textures no other model uses). Called by a scene when it has acquired its models, so the models of the previous scenes which it does not use are freed.
+//
+//  *** "update(budget)":
+//  - called once per frame, uploads the textures which are being streamed.
+//
+
+#ifndef model_registry_h
+#define model_registry_h
+
+#include "model.h"
+#include "model_loader.h"
+#include "texture_streamer.h"
+
+#include <cstdlib>
+#include <climits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+
+class ModelRegistry;
+
+// counted reference to a model in the registry - the model is not deleted while a handle to it exists
+class ModelHandle {
+private:
+    ModelRegistry* registry = nullptr;
+    unsigned int id = 0;
+
+    inline void retain() const;
+    inline void release() const;
+
+public:
+    ModelHandle() {}
+    ModelHandle(ModelRegistry* registry, unsigned int id) : registry(registry), id(id) {
+        retain();
+    }
+
+    ModelHandle(const ModelHandle& other) : registry(other.registry), id(other.id) {
+        retain();
+    }
+
+    ModelHandle(ModelHandle&& other) noexcept : registry(other.registry), id(other.id) {
+        other.registry = nullptr;
+    }
+
+    ModelHandle& operator=(ModelHandle other) noexcept {
+        std::swap(registry, other.registry);
+        std::swap(id, other.id);
+        return *this;
+    }
+
+    ~ModelHandle() {
+        release();
+    }
+
+    Model& operator*() const;
+    Model* operator->() const;
+
+    inline bool isValid() const {
+        return registry != nullptr;
+    }
+
+    // handles to the same model have the same id
+    inline unsigned int getId() const {
+        return id;
+    }
+};
+
+class ModelRegistry {
+private:
+    struct Entry {
+        std::string path; // resolved path and the code of the vertex format
+        std::unique_ptr<Model> model;
+        unsigned int references = 0;
+    };
+
+    std::vector<Entry> entries; // by the id of the model
+    std::vector<unsigned int> free_ids; // entries of the deleted models
+    std::unordered_map<std::string, unsigned int> by_path;
+
+    TextureStreamer texture_streamer;
+    ModelLoader loader{texture_streamer};
+
+    static std::string resolve(const std::string& path) {
+        char real_path[PATH_MAX];
+        return realpath(path.c_str(), real_path) ? std::string(real_path) : path;
+    }
+
+    friend class ModelHandle;
+
+public:
+    ModelRegistry() {}
+
+    ModelRegistry(const ModelRegistry&) = delete;
+    ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+    ModelHandle acquire(const std::string& path, const VertexFormat& format = VertexFormat()) {
+        std::string file = resolve(path) + "#" + std::to_string(format.code());
+        std::unordered_map<std::string, unsigned int>::const_iterator it = by_path.find(file);
+        if(it != by_path.end()) return ModelHandle(this, it->second);
+
+        unsigned int id = (unsigned int)entries.size();
+        if(!free_ids.empty()) {
+            id = free_ids.back();
+            free_ids.pop_back();
+        }
+        else entries.emplace_back();
+
+        Entry& entry = entries[id];
+        entry.path = file;
+        entry.model.reset(new Model());
+        loader.load(path, *entry.model, format);
+        by_path[file] = id;
+        return ModelHandle(this, id);
+    }
+
+    void releaseUnused() {
+        loader.finish(); // the loader writes to the models
+        for(unsigned int id = 0; id < entries.size(); id++) {
+            Entry& entry = entries[id];
+            if(!entry.model || entry.references > 0) continue;
+
+            std::vector<Texture> textures = entry.model->textures_loaded;
+            entry.model.reset();
+            // the images still streamed must not be specified in a deleted texture (the name can be generated again)
+            for(const Texture& texture : textures) {
+                if(TextureRegistry::references(texture.ID) == 0) texture_streamer.cancel(texture.ID);
+            }
+            by_path.erase(entry.path);
+            entry.path.clear();
+            free_ids.push_back(id);
+        }
+    }
+
+    // wait for the models which are being loaded (their textures are streamed later)
+    void finish() {
+        loader.finish();
+    }
+
+    void update(size_t budget = TEXTURE_STREAMING_BUDGET) {
+        texture_streamer.update(budget);
+    }
+};
+
+inline void ModelHandle::retain() const {
+    if(registry) registry->entries[id].references++;
+}
+
+inline void ModelHandle::release() const {
+    if(registry) registry->entries[id].references--;
+}
+
+inline Model& ModelHandle::operator*() const {
+    return *registry->entries[id].model;
+}
+
+inline Model* ModelHandle::operator->() const {
+    return registry->entries[id].model.get();
+}
+
+#endif /* model_registry_h */
@@ -18,6 +18,7 @@
 
 #include "shader.h"
 #include "camera.h"
+#include "gl_state.h"
 
 class Plane {
 private:
@@ -39,7 +40,7 @@ public:
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
-        glBindVertexArray(VAO);
+        GLState::bindVertexArray(VAO);
         
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
@@ -52,25 +53,22 @@ public:
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         
-        glBindVertexArray(0);
+        GLState::bindVertexArray(0);
     }
     ~Plane() {
+        GLState::forgetVertexArray(VAO);
         glDeleteVertexArrays(1, &VAO);
     }
-    void draw(Camera* camera) {
+    // the position of the camera is read from the FrameUniforms block
+    void draw() {
         
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GLState::setEnabled(GL_BLEND, true);
+        GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         
         plane_shader.use();
         
-        camera->transferData(plane_shader);
-        plane_shader.setVec3("camera_position", camera->position);
-        
-        glBindVertexArray(VAO);
+        GLState::bindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        
-        glDisable(GL_BLEND);
     }
 };
 
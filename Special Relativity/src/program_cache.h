@@ -0,0 +1,134 @@
+//
+//  program_cache.h
+//  Special Relativity
+//
+//  Cache of the linked shader programs (glGetProgramBinary/glProgramBinary), so the shaders are compiled only the first time the program starts. The binary of a program is kept in the "cache" folder, in a file named after the hash of its final source code (with the custom code and the definitions inserted), the transform feedback varyings and the driver (vendor, renderer, version) - a different source or an updated driver gives a different file, so the program is compiled again.
+//  If the driver refuses the binary, the program is compiled from the source and the binary is replaced. Some drivers (e.g. macOS) support no binary formats - then the programs are always compiled.
+//
+//  *** "ProgramCache::key(sources)":
+//  - the hash identifying the program.
+//
+//  *** "ProgramCache::load(program, key)":
+//  - loads the cached binary into the program, returns false if there is no valid binary (the program has to be compiled then).
+//
+//  *** "ProgramCache::save(program, key)":
+//  - saves the binary of the linked program.
+//
+
+#ifndef program_cache_h
+#define program_cache_h
+
+#include <glad/glad.h>
+
+#include "hash.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+const char* const PROGRAM_CACHE_DIRECTORY = "cache";
+const std::uint32_t PROGRAM_CACHE_VERSION = 1;
+
+class ProgramCache {
+private:
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t format; // binary format given by the driver
+        std::uint64_t key;
+        std::uint64_t length; // the binary follows the header
+    };
+
+    static std::string path(std::uint64_t key) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.program", (unsigned long long)key);
+        return std::string(PROGRAM_CACHE_DIRECTORY) + "/" + name;
+    }
+
+    static std::string glString(GLenum name) {
+        const GLubyte* text = glGetString(name);
+        return text ? std::string((const char*)text) : std::string();
+    }
+
+public:
+    static bool isSupported() {
+        static int formats = -1;
+        if(formats < 0) {
+            formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        return formats > 0;
+    }
+
+    static std::uint64_t key(const std::vector<std::string>& sources) {
+        static const std::string driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION) + "|" + glString(GL_SHADING_LANGUAGE_VERSION);
+        std::uint64_t value = fnv1a(driver);
+        for(const std::string& source : sources) value = fnv1a(source, value);
+        return value;
+    }
+
+    static bool load(unsigned int program, std::uint64_t key) {
+        if(!isSupported()) return false;
+        std::ifstream file(path(key), std::ios::binary);
+        if(!file) return false;
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        Header header;
+        if(data.size() < sizeof(Header)) return false;
+        std::memcpy(&header, data.data(), sizeof(Header));
+        if(std::memcmp(header.magic, "SRPROG\0\0", 8) != 0 || header.version != PROGRAM_CACHE_VERSION || header.key != key || data.size() != sizeof(Header) + header.length) return false;
+
+        glProgramBinary(program, header.format, data.data() + sizeof(Header), (GLsizei)header.length);
+        int success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success != 0;
+    }
+
+    static void save(unsigned int program, std::uint64_t key) {
+        if(!isSupported()) return;
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0) return;
+
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "SRPROG\0\0", 8);
+        header.version = PROGRAM_CACHE_VERSION;
+        header.key = key;
+        std::vector<char> data(sizeof(Header) + length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, data.data() + sizeof(Header));
+        if(written <= 0) return;
+        header.format = format;
+        header.length = (std::uint64_t)written;
+        std::memcpy(data.data(), &header, sizeof(Header));
+        data.resize(sizeof(Header) + written);
+
+        mkdir(PROGRAM_CACHE_DIRECTORY, 0755);
+        // write to a temporary file first, so a binary which is being written is never read
+        std::string cache_path = path(key);
+        std::string temporary_path = cache_path + ".tmp";
+        FILE* output = std::fopen(temporary_path.c_str(), "wb");
+        if(!output) {
+            std::cout << "ERROR::PROGRAM_CACHE: Could not write the binary of the program" << std::endl;
+            return;
+        }
+        bool saved = std::fwrite(data.data(), 1, data.size(), output) == data.size();
+        saved = std::fclose(output) == 0 && saved;
+        if(!saved || std::rename(temporary_path.c_str(), cache_path.c_str()) != 0) {
+            std::cout << "ERROR::PROGRAM_CACHE: Could not write the binary of the program" << std::endl;
+            std::remove(temporary_path.c_str());
+        }
+    }
+};
+
+#endif /* program_cache_h */
@@ -6,15 +6,19 @@
 //
 //  To change the scenario of the scene, modify the code in "setUpScene" function. The functions have to be used in a sequence. The added object uses the last added model and last added shader (there has to be at least one loaded shader and at least one model loaded). Useful functions:
 //
-//  *** "addRelativisticShader(const char* custom_vertex_fragment = nullptr)":
+//  *** "addRelativisticShader(const char* custom_vertex_fragment = nullptr, float extent_scale = 1.0f, float extent_offset = 0.0f)":
 //  - used to add a relativistic shader to the object. If no input in the argument - the object will perform no transformations in it's own frame. Optional argument - a GLSL code which changes the transformation in the local frame of the object. Use mat4 "custom" to transfer additional data to the function. To make the code shorter use two pre-made functions:
 //  * "mat3 rotate(in vec3 axis, float angle)":
 //  - rotate a vector by a specified angle around a specified axis
 //  * "mat3 scale(in vec3 size)":
 //  - scale a vector by a specified size (around center)
+//  If the code does not depend on "t_local" (or there is no code), the light cone equation is solved analytically. The objects of the same code share one program and are drawn together.
+//  Optional arguments "extent_scale" and "extent_offset" - the vertices are assumed to stay within (extent_scale * radius of the model + extent_offset) from the origin of the object, which narrows the interval searched by the solver.
+//
+//  Only the visible objects are drawn (see "kinetic_bvh.h"), the objects which share a model and a shader are drawn with instanced draw calls, each at the level of detail of its apparent size (see "instance_buffer.h" and "mesh_simplifier.h"). The optional modes are described at "toggleTessellation", "toggleWarmStart" and "toggleApparentCache".
 //
 //  *** "addModel(const std::string &path)":
-//  - used to add a model of an object at a given path.
+//  - used to add a model of an object at a given path. The models are shared through the "ModelRegistry" given to the scene and loaded in parallel after "setUpScene" returns (see "model_registry.h").
 //
 //  *** "addObject(float pos_x, float pos_y, float pos_z, float v_x, float v_y, float v_z, const glm::mat4& custom)" OR "addObject(float pos_x, float pos_y, float pos_z, float v_x, float v_y, float v_z, float c_x = 0, float c_y = 0, float c_z = 0, float c_w = 0)":
 //  - used to add an object to the scene. The arguments are self explanatory.
@@ -22,7 +26,7 @@
 //
 // EXAMPLE SCENARIO 1 - adds 201 boxes next to each other which perform sinusoidal synchronized oscillations in their own frame. The frame moves at 90% of speed of light in x-direction, relative to the camera.
 //
-// addRelativisticShader("return aPos+custom[0].xyz*sin(t_local*custom[0].w)+custom[1].xyz;");
+// addRelativisticShader("return aPos+custom[0].xyz*sin(t_local*custom[0].w)+custom[1].xyz;", 1.0f, 301.0f);
 // addModel("assets/objects/cube_textured_complex/cube.obj");
 // for(int i = -100; i < 100; i++) {
 //    glm::mat4 custom(glm::vec4(0, 1.0f, 0, 0.5f), glm::vec4(i*3.0f, 0, 0, 0), glm::vec4(0), glm::vec4(0));
@@ -49,8 +53,33 @@
 #include "shader.h"
 #include "camera.h"
 #include "plane.h"
+#include "sr_solver.h"
+#include "warm_start.h"
+#include "instance_buffer.h"
+#include "apparent_geometry.h"
+#include "uniform_blocks.h"
+#include "gl_state.h"
+#include "model_registry.h"
+#include "frustum.h"
+#include "kinetic_bvh.h"
 
 #include <vector>
+#include <map>
+#include <utility>
+#include <string>
+#include <cctype>
+#include <algorithm>
+
+// the warm start is used only for the groups with at most this many visible objects - it draws every object separately, which costs more than the saved iterations when the instancing batches many objects
+const unsigned int WARM_START_MAX_INSTANCES = 8;
+// the warm start falls back to the full search if the camera moves or the time changes by more than this in one frame
+const float WARM_START_MAX_DISPLACEMENT = 5.0f;
+const float WARM_START_MAX_TIME_STEP = 1.0f;
+
+// the level of detail of an object is the simplest one whose error covers less than this many pixels
+const float LOD_PIXEL_ERROR = 1.0f;
+// a simpler level is used only when its error is this part below the limit, a more detailed one when the error is this part above it
+const float LOD_HYSTERESIS = 0.25f;
 
 class Scene {
 private:
@@ -61,22 +90,105 @@ private:
         
         glm::vec3 velocity;
         glm::mat4 custom_data;
+        
+        float bounding_radius; // all the vertices stay within this distance from the position (IN S' FRAME)
+        float extent_scale, extent_offset; // extent of the relativistic shader, the bounding radius is found when the model is loaded
     };
 
     std::vector<Object> objects;
-    std::vector<Model> models;
+    ModelRegistry& model_registry;
+    std::vector<ModelHandle> models; // every model used by the scene once
+    // model added by "addModel", loaded by "acquireModels" with the vertex format of the shader
+    struct ModelRequest {
+        std::string path;
+        unsigned int shader_id;
+    };
+    
+    std::vector<ModelRequest> model_requests;
+    unsigned int current_model = 0; // the model of the added objects (index in "model_requests" until the models are acquired)
     std::vector<Shader> shaders;
+    unsigned int current_shader = 0; // the shader of the added objects
+    std::map<std::string, unsigned int> relativistic_shader_ids; // by the expanded source (custom code and definitions)
+    
+    // variants of a time-dependent relativistic shader used by the warm start
+    struct WarmStartShaders {
+        Shader feedback; // WARM_START - solves the local times of the vertices and captures them
+        Shader render; // SOLVED_TIME - draws the object at the captured local times
+    };
+    
+    // all the objects drawn with the same relativistic shader and model
+    struct InstanceGroup {
+        unsigned int shader_id;
+        unsigned int model_id;
+        InstanceBuffer instances;
+        std::vector<unsigned int> object_ids; // all the objects of the group
+        std::vector<unsigned int> drawn_ids; // the objects in the buffer at the moment, sorted by their levels of detail
+        std::vector<unsigned int> level_first; // index in "drawn_ids" of the first object of every level, the number of the objects at the end
+        ApparentGeometry apparent; // the vertices solved in this frame, if the cache is on
+        bool warm_started = false; // drawn with the warm start in this frame (see "selectWarmStartGroups")
+    };
+    
+    std::vector<InstanceGroup> instance_groups;
+    std::vector<InstanceData> object_instances; // for every object
+    
+    // result of the frustum culling in the last frame
+    std::vector<char> object_visible; // for every object
+    std::vector<InstanceData> visible_instances;
+    std::vector<glm::vec4> time_brackets; // of the visible objects of a group
+    unsigned int drawn_objects = 0, culled_objects = 0;
+    KineticBVH bvh; // the objects moving through the scene, queried for the visible ones
+    std::vector<unsigned int> visible_ids;
+    
+    std::vector<unsigned char> object_levels; // level of detail of every object
+    std::vector<unsigned int> level_ids; // the visible objects of a group sorted by their levels
+    glm::vec2 viewport = glm::vec2(1600.0f, 900.0f); // in pixels
+    size_t processed_vertices = 0, full_detail_vertices = 0; // in the last frame, "full_detail_vertices" - if all the objects were drawn with the full models
+    
+    // state of the frame shared by all the shaders and the data of the objects drawn without instancing (see "uniform_blocks.h")
+    UniformBuffer<FrameUniforms> frame_buffer{FRAME_UNIFORMS_BINDING};
+    UniformBuffer<ObjectUniforms> object_buffer{OBJECT_UNIFORMS_BINDING};
+    glm::mat4 screen_projection = glm::mat4(1.0f);
+    
+    std::vector<WarmStartShaders> warm_start_shaders;
+    std::vector<int> warm_start_shader_id; // for every shader: index in "warm_start_shaders", -1 if the shader cannot use the warm start
+    std::vector<WarmStart> warm_starts; // for every object, created when the warm start is turned on for the first time
+    std::vector<unsigned int> warm_start_ids; // the objects of a shader drawn with the warm start in this frame
+    
+    // the code of a capture shader, kept until the cache is turned on
+    struct CaptureSource {
+        bool has_custom_vertex_fragment;
+        std::string custom_vertex_fragment;
+        std::string defines;
+    };
+    
+    std::vector<CaptureSource> capture_sources;
+    std::vector<Shader> capture_shaders; // compiled from "capture_sources" when the cache is turned on for the first time
+    std::vector<int> capture_shader_id; // for every shader: index in "capture_sources" and "capture_shaders", -1 if the shader is not relativistic
+    Shader apparent_shader; // draws the vertices solved by the capture shaders, the same for all of them
+    std::vector<unsigned int> cached_groups; // the groups solved in this frame
+    
+    bool warm_start = false;
+    bool tessellation = false;
+    bool apparent_cache = false;
+    bool warm_start_reset = true; // the times from the previous frame cannot be used in the next one
+    glm::vec3 last_camera_position = glm::vec3(0.0f);
+    float time_flow_speed = 1.0f;
+    bool last_show_true_position = false;
     
     Plane plane;
     
     float speed_of_light = 1.0f;
     
+    // extent of the last added relativistic shader
+    float extent_scale = 1.0f;
+    float extent_offset = 0.0f;
+    
     void setUpScene() {
         glm::mat4 custom;
         
         
         //SCENARIO 1 - Terell rotation, Lorentz contraction - BOX
-        addRelativisticShader("return aPos+custom[0].xyz;");
+        addRelativisticShader("return aPos+custom[0].xyz;", 1.0f, 15.0f);
         addModel("assets/objects/die/die.obj");
         for(int i = -5; i <= 5; i++) {
             custom = glm::mat4(glm::vec4(i*3.0f, 0, 0, 0), glm::vec4(0), glm::vec4(0), glm::vec4(0));
@@ -86,13 +198,14 @@ private:
         
         
         //SCENARIO 2 - Time dilation - CLOCKS
-        /*addModel("assets/objects/clock/clock.obj");
-        addRelativisticShader("return rotate(custom[0].xyz, t_local*custom[0].w)*custom[1].x*aPos;");
+        /*addRelativisticShader("return rotate(custom[0].xyz, t_local*custom[0].w)*custom[1].x*aPos;");
+        addModel("assets/objects/clock/clock.obj");
         custom = glm::mat4(glm::vec4(0), glm::vec4(0.575, 0, 0, 0), glm::vec4(0), glm::vec4(0));
         for(int i = 0; i < 3; i++) {
             addObject(0.0f, i*2.0f, -20, 0.33f*i, 0.0f, 0.0f, custom);
         }
         addObject(0.0f, 6.0f, -20, 0.9, 0.0f, 0.0f, custom);
+        addRelativisticShader("return rotate(custom[0].xyz, t_local*custom[0].w)*custom[1].x*aPos;"); // the same program as the clock
         addModel("assets/objects/clock/clock_tick.obj");
         custom = glm::mat4(glm::vec4(0, 0, 1.0f, 0.5257f), glm::vec4(0.575, 0, 0, 0), glm::vec4(0), glm::vec4(0));
         for(int i = 0; i < 3; i++) {
@@ -102,7 +215,7 @@ private:
         
         
         //SCENARIO 3 - BOX SEQUENCE
-        /*addRelativisticShader("return aPos+custom[0].xyz*sin(t_local*custom[0].w)+custom[1].xyz;");
+        /*addRelativisticShader("return aPos+custom[0].xyz*sin(t_local*custom[0].w)+custom[1].xyz;", 1.0f, 151.0f);
         addModel("assets/objects/die/die.obj");
         for(int i = -50; i < 50; i++) {
             custom = glm::mat4(glm::vec4(0, 1.0f, 0, 0.5f), glm::vec4(i*3.0f, 0, 0, 0), glm::vec4(0), glm::vec4(0));
@@ -132,70 +245,193 @@ private:
         
         
         //SCENARIO 6 - RELATIVISTIC ABERRATION
-        /*addRelativisticShader("return aPos*100.0f;");
+        /*addRelativisticShader("return aPos*100.0f;", 100.0f);
         addModel("assets/objects/universe/universe.obj");
         addObject(0.0f, 1, 0, 0, 0, 0.99f);*/
         
+        
+        //SCENARIO 7 - 10000 OSCILLATING BOXES (drawn with instancing)
+        /*addRelativisticShader("return aPos+custom[0].xyz*sin(t_local*custom[0].w)+custom[1].xyz;", 1.0f, 2.0f);
+        addModel("assets/objects/die/die.obj");
+        for(int i = -50; i < 50; i++) {
+            for(int j = -50; j < 50; j++) {
+                custom = glm::mat4(glm::vec4(0, 1.0f, 0, 0.5f), glm::vec4(0), glm::vec4(0), glm::vec4(0));
+                addObject(i*3.0f, 0, j*3.0f - 20.0f, 0.1f + 0.008f*(j+50), 0.0f, 0.0f, custom);
+            }
+        }*/
+        
     }
 public:
     
     float time = 0;
     
-    Scene() {
+    Scene(ModelRegistry& model_registry) : model_registry(model_registry) {
         //load coords shader first
         addShader("src/shaders/default/default.vs", "src/shaders/default/default.fs");
         addModel("assets/objects/coords/coords2.obj");
         addModel("assets/objects/coords/arrow.obj");
         
         setUpScene();
+        acquireModels();
+        // the objects of a shared shader are drawn in one pass
+        std::stable_sort(objects.begin(), objects.end(), [](const Object& a, const Object& b) { return a.shader_id < b.shader_id; });
+        model_registry.finish();
+        model_registry.releaseUnused();
+        for(Object& object : objects) object.bounding_radius = object.extent_scale * models[object.model_id]->bounding_radius + object.extent_offset;
+        groupInstances();
     }
     
    void draw(Camera* camera, float ratio, float delta_time, bool show_true_position, bool turn_off_doppler){
-       unsigned int current_object = 0;
        time += delta_time;
        
+       glm::vec3 camera_displacement = camera->position - last_camera_position;
+       if(glm::length(camera_displacement) > WARM_START_MAX_DISPLACEMENT || glm::abs(delta_time) > WARM_START_MAX_TIME_STEP || show_true_position != last_show_true_position) warm_start_reset = true;
+       last_camera_position = camera->position;
+       last_show_true_position = show_true_position;
+       
+       FrameUniforms frame;
+       frame.PV = camera->getProjectionView();
+       frame.screen_projection = screen_projection;
+       frame.camera = glm::vec4(time, camera->position);
+       frame.speed_of_light = speed_of_light;
+       frame.c_2_inv = 1/(speed_of_light*speed_of_light);
+       frame.viewport = viewport;
+       frame_buffer.set(0, frame);
+       frame_buffer.upload();
+       
+       GLState::setEnabled(GL_BLEND, false);
+       
+       cullObjects(camera, frame.PV, show_true_position);
+       selectLevels(camera, show_true_position);
+       updateInstanceGroups(camera);
+       processed_vertices = full_detail_vertices = 0;
+       
+       // the relativistic shaders are compiled separately for every mode
+       unsigned int permutation = (show_true_position ? SHADER_TRUE_POSITION : 0) | (turn_off_doppler ? SHADER_NO_DOPPLER : 0);
+       if(tessellation) glPatchParameteri(GL_PATCH_VERTICES, 3);
+       cached_groups.clear();
+       
        for(unsigned int i = 1; i < shaders.size(); i++) {
-           shaders[i].use();
+           if(warm_start && warm_start_shader_id[i] >= 0) {
+               WarmStartShaders* variants = &warm_start_shaders[warm_start_shader_id[i]];
+               // drawn without the warm start until its variants are compiled
+               bool ready = variants->feedback.permutation(permutation).isReady() && variants->render.permutation(permutation).isReady();
+               if(selectWarmStartGroups(i, ready)) drawWarmStart(camera, variants, permutation, delta_time, camera_displacement);
+           }
            
-           shaders[i].setBool("show_true_position", show_true_position);
-           shaders[i].setBool("turn_off_doppler", turn_off_doppler);
+           if(apparent_cache && !tessellation && capture_shader_id[i] >= 0 && solveApparent(i, permutation)) continue;
            
-           camera->transferData(shaders[i]);
-           shaders[i].setVec4("camera", glm::vec4(time, camera->position));
-           shaders[i].setFloat("speed_of_light", speed_of_light);
+           const Shader* shader = &shaders[i].permutation(permutation | (tessellation ? SHADER_TESSELLATED : 0));
+           if(!shader->isReady()) shader = &shaders[i].permutation(permutation); // without the tessellation until it is compiled
+           if(!shader->isReady()) shader = &shaders[i]; // the default mode until the permutation is compiled
+           if(!shader->isReady()) continue; // the objects appear when their program is compiled
+           shader->use();
+           GLenum mode = tessellation && shader == &shaders[i].permutation(permutation | SHADER_TESSELLATED) ? GL_PATCHES : GL_TRIANGLES;
            
-           for(unsigned int j = current_object; j < objects.size(); j++) {
-               if(i == objects[j].shader_id) {
-                   setRelativisticParameters(camera, &objects[j], &shaders[i]);
-                   
-                   models[objects[j].model_id].draw(shaders[i]);
-                   
-                   current_object++;
-               } else break;
+           for(unsigned int k = 0; k < instance_groups.size(); k++) {
+               InstanceGroup& group = instance_groups[k];
+               if(group.shader_id != i || group.warm_started) continue;
+               Model& model = *models[group.model_id];
+               // one draw call for every level of detail of the model
+               for(unsigned int level = 0; level + 1 < group.level_first.size(); level++) {
+                   unsigned int count = group.level_first[level + 1] - group.level_first[level];
+                   group.instances.draw(model, *shader, group.level_first[level], count, level, mode);
+               }
+               countVertices(group);
            }
        }
+       
+       drawApparent(permutation);
+       
+       warm_start_reset = false;
+    }
+    
+    // reuse the local times solved in the previous frame (see "warm_start.h") - only for the groups of at most WARM_START_MAX_INSTANCES visible objects at the full level of detail, as every object is drawn separately
+    void toggleWarmStart() {
+        warm_start = !warm_start;
+        warm_start_reset = true;
+        if(warm_start && warm_starts.empty()) {
+            warm_starts.reserve(objects.size());
+            for(unsigned int j = 0; j < objects.size(); j++) warm_starts.emplace_back(*models[objects[j].model_id]);
+        }
+    }
+    
+    inline bool isWarmStartOn() const {
+        return warm_start;
+    }
+
+    // split the edges of the instanced objects whose apparent midpoint is more than a pixel away from their chord, so they look curved (see "sr_ray.vs")
+    void toggleTessellation() {
+        tessellation = !tessellation;
+    }
+
+    inline bool isTessellationOn() const {
+        return tessellation;
+    }
+    
+    // solve every vertex of the instanced objects once per frame into a buffer, which is then drawn without solving again (see "apparent_geometry.h") - the variants are compiled when it is turned on for the first time
+    void toggleApparentCache() {
+        apparent_cache = !apparent_cache;
+        if(apparent_cache) compileApparentShaders();
+    }
+    
+    inline bool isApparentCacheOn() const {
+        return apparent_cache;
+    }
+    
+    // number of the objects drawn and skipped by the frustum culling in the last frame
+    inline unsigned int drawnObjects() const {
+        return drawn_objects;
+    }
+    
+    inline unsigned int culledObjects() const {
+        return culled_objects;
+    }
+    
+    // number of the vertices drawn in the last frame, with the levels of detail and if all the objects had the full models
+    inline size_t processedVertices() const {
+        return processed_vertices;
+    }
+    
+    inline size_t fullDetailVertices() const {
+        return full_detail_vertices;
+    }
+    
+    // the size of the viewport in pixels, used to find how large the errors of the levels of detail and the curvature of the edges are on the screen
+    inline void setViewport(float width, float height) {
+        viewport = glm::vec2(width, height);
+    }
+    
+    // the projection used by the GUI, sent to the shaders with the rest of the frame state
+    inline void setScreenProjection(const glm::mat4& projection) {
+        screen_projection = projection;
+    }
+    
+    // the time step changes with the time flow speed, so the local times from the previous frame cannot be used as a starting point
+    void setTimeFlowSpeed(float time_flow_speed) {
+        if(time_flow_speed != this->time_flow_speed) warm_start_reset = true;
+        this->time_flow_speed = time_flow_speed;
     }
     
     void drawPos(Camera* camera, float ratio, bool show_true_position){
-        plane.draw(camera);
+        plane.draw();
         
         glClear(GL_DEPTH_BUFFER_BIT); //make the coords always on top
+        GLState::setEnabled(GL_BLEND, false);
         
         shaders[0].use();
         
-        camera->transferData(shaders[0]);
-        
         for(unsigned int j = 0; j < objects.size(); j++) {
             glm::mat4 model = glm::translate(glm::mat4(1.0f), objects[j].position+objects[j].velocity*time-camera->position);
             shaders[0].setMat4("model", model);
-            models[0].draw(shaders[0]); //draw coordinates
+            models[0]->draw(shaders[0]); //draw coordinates
             
             if(!show_true_position){
                 model = glm::mat4(1.0f);
                 model = glm::translate(model, objects[j].position+objects[j].velocity*(findTime(camera, objects[j]))-camera->position);
                 model = model * rotateVelocityArrow(&objects[j]); //rotate the arrow in the direction of motion
                 shaders[0].setMat4("model", model);
-                models[1].draw(shaders[0]); //draw velocity vector arrow
+                models[1]->draw(shaders[0]); //draw velocity vector arrow
             }
         }
     }
@@ -220,10 +456,218 @@ private:
         return glm::rotate(glm::mat4(1.0f), angle, rot_axis);
     }
     
-    inline void setRelativisticParameters(Camera* camera, Object* object, Shader* shader) {
-        shader->setVec3("initial_pos", object->position);
-        shader->setVec3("velocity", object->velocity);
-        shader->setMat4("custom", object->custom_data);
+    // upload the data of the objects to one instance buffer for every pair (shader, model)
+    void groupInstances() {
+        std::map<std::pair<unsigned int, unsigned int>, std::vector<unsigned int>> groups;
+        object_instances.resize(objects.size());
+        for(unsigned int j = 0; j < objects.size(); j++) {
+            InstanceData& instance = object_instances[j];
+            SRSolver solver(objects[j].position, objects[j].velocity, glm::vec4(0.0f), speed_of_light); // the invariants do not depend on the camera
+            instance.initial_pos = glm::vec4(objects[j].position, objects[j].bounding_radius);
+            instance.velocity = glm::vec4(objects[j].velocity, solver.getVelocitySq());
+            instance.custom = objects[j].custom_data;
+            instance.boost = solver.boost();
+            groups[std::make_pair(objects[j].shader_id, objects[j].model_id)].push_back(j);
+        }
+        
+        instance_groups.clear();
+        for(auto& group : groups) {
+            std::vector<InstanceData> instances;
+            for(unsigned int j : group.second) instances.push_back(object_instances[j]);
+            instance_groups.push_back({group.first.first, group.first.second, InstanceBuffer(instances), group.second, group.second, std::vector<unsigned int>(), ApparentGeometry()});
+        }
+        
+        object_buffer = UniformBuffer<ObjectUniforms>(OBJECT_UNIFORMS_BINDING, objects.size());
+        object_visible.assign(objects.size(), 1);
+        object_levels.assign(objects.size(), 0);
+        
+        std::vector<KineticBVH::Item> items(objects.size());
+        for(unsigned int j = 0; j < objects.size(); j++) items[j] = {objects[j].position, objects[j].velocity, objects[j].bounding_radius};
+        bvh.build(items, time, speed_of_light);
+    }
+    
+    // the objects are found in the hierarchy, the image of an object is a sphere around the apparent position of its origin (see "KineticBVH::isVisible")
+    void cullObjects(const Camera* camera, const glm::mat4& PV, bool show_true_position) {
+        bvh.update(time);
+        visible_ids.clear();
+        bvh.query(Frustum(PV), camera->position, time, show_true_position, visible_ids);
+        
+        std::fill(object_visible.begin(), object_visible.end(), 0);
+        for(unsigned int j : visible_ids) object_visible[j] = 1;
+        drawn_objects = (unsigned int)visible_ids.size();
+        culled_objects = (unsigned int)objects.size() - drawn_objects;
+    }
+    
+    // the simplest level of detail whose error covers less than LOD_PIXEL_ERROR pixels, changed only outside of the hysteresis band
+    void selectLevels(const Camera* camera, bool show_true_position) {
+        float pixels_per_radian = viewport.y / (2.0f * glm::tan(0.5f * glm::radians(camera->getFov())));
+        for(unsigned int j : visible_ids) {
+            const Object& object = objects[j];
+            const Model& model = *models[object.model_id];
+            unsigned int level_count = model.lodCount();
+            if(level_count <= 1) continue;
+            
+            // the object is seen where it emitted the light, the Doppler factor magnifies the image of an approaching object
+            glm::vec3 offset = camera->position - (object.position + object.velocity * (show_true_position ? time : findTime(camera, object)));
+            float distance = glm::length(offset);
+            float magnification = 1.0f;
+            if(!show_true_position && distance > 0.0f) {
+                glm::vec3 beta = object.velocity / speed_of_light;
+                magnification = glm::sqrt(1.0f - glm::dot(beta, beta)) / (1.0f - glm::dot(beta, offset / distance));
+            }
+            float pixels_per_unit = object.extent_scale * magnification * pixels_per_radian / glm::max(distance - object.bounding_radius, 1e-6f);
+            
+            unsigned int level = std::min<unsigned int>(object_levels[j], level_count - 1);
+            while(level + 1 < level_count && model.lodError(level + 1) * pixels_per_unit < LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS)) level++;
+            while(level > 0 && model.lodError(level) * pixels_per_unit > LOD_PIXEL_ERROR * (1.0f + LOD_HYSTERESIS)) level--;
+            object_levels[j] = (unsigned char)level;
+        }
+    }
+    
+    // send the visible objects of the group (sorted by their levels of detail) to its instance buffer, if they changed since the last frame
+    void updateVisibleInstances(InstanceGroup& group) {
+        unsigned int level_count = std::max(models[group.model_id]->lodCount(), 1u);
+        group.level_first.assign(level_count + 1, 0);
+        for(unsigned int j : group.object_ids) {
+            if(object_visible[j]) group.level_first[std::min<unsigned int>(object_levels[j], level_count - 1) + 1]++;
+        }
+        for(unsigned int level = 0; level < level_count; level++) group.level_first[level + 1] += group.level_first[level];
+        
+        level_ids.resize(group.level_first.back());
+        std::vector<unsigned int> next(group.level_first.begin(), group.level_first.end() - 1);
+        for(unsigned int j : group.object_ids) {
+            if(object_visible[j]) level_ids[next[std::min<unsigned int>(object_levels[j], level_count - 1)]++] = j;
+        }
+        if(level_ids == group.drawn_ids) return;
+        
+        group.drawn_ids.swap(level_ids);
+        visible_instances.clear();
+        for(unsigned int j : group.drawn_ids) visible_instances.push_back(object_instances[j]);
+        group.instances.update(visible_instances);
+    }
+    
+    // the visible objects of every group and their time brackets, which move with the time of the camera - calculated once per object instead of for every vertex
+    void updateInstanceGroups(const Camera* camera) {
+        for(InstanceGroup& group : instance_groups) {
+            group.warm_started = false;
+            updateVisibleInstances(group);
+            time_brackets.clear();
+            for(unsigned int j : group.drawn_ids) {
+                SRSolver solver(objects[j].position, objects[j].velocity, glm::vec4(time, camera->position), speed_of_light);
+                time_brackets.push_back(solver.timeBracket(objects[j].bounding_radius));
+            }
+            group.instances.updateTimeBrackets(time_brackets);
+        }
+    }
+    
+    // the vertices solved for the visible objects of the group, with the levels of detail and if all the objects had the full models
+    void countVertices(const InstanceGroup& group) {
+        const Model& model = *models[group.model_id];
+        for(unsigned int level = 0; level + 1 < group.level_first.size(); level++) {
+            unsigned int count = group.level_first[level + 1] - group.level_first[level];
+            processed_vertices += (size_t)count * model.lodVertexCount(level);
+            full_detail_vertices += (size_t)count * model.lodVertexCount(0);
+        }
+    }
+    
+    // solve the vertices of the visible objects of the shader once (transform feedback, nothing is rasterized), they are drawn by "drawApparent" - false if the variants are not compiled yet or the vertices do not fit in the buffers, then the shader is drawn without the cache
+    bool solveApparent(unsigned int shader_id, unsigned int permutation) {
+        const Shader& capture = capture_shaders[capture_shader_id[shader_id]].permutation(permutation);
+        if(!capture.isReady() || !apparent_shader.permutation(permutation).isReady()) return false;
+        for(InstanceGroup& group : instance_groups) {
+            if(group.shader_id != shader_id || group.warm_started) continue;
+            if(!group.apparent.fits(*models[group.model_id], group.level_first)) return false;
+        }
+        
+        capture.use();
+        GLState::setEnabled(GL_RASTERIZER_DISCARD, true);
+        for(unsigned int k = 0; k < instance_groups.size(); k++) {
+            InstanceGroup& group = instance_groups[k];
+            if(group.shader_id != shader_id || group.warm_started) continue;
+            group.apparent.solve(*models[group.model_id], group.instances, group.level_first);
+            countVertices(group);
+            cached_groups.push_back(k);
+        }
+        GLState::setEnabled(GL_RASTERIZER_DISCARD, false);
+        return true;
+    }
+    
+    // draw the solved vertices
+    void drawApparent(unsigned int permutation) {
+        if(cached_groups.empty()) return;
+        
+        const Shader& shader = apparent_shader.permutation(permutation);
+        shader.use();
+        for(unsigned int k : cached_groups) instance_groups[k].apparent.draw(*models[instance_groups[k].model_id], instance_groups[k].instances, shader);
+    }
+    
+    // the warm start draws every object separately with the full model, so it is used only for the groups which lose nothing by it - at most WARM_START_MAX_INSTANCES visible objects, all at the full level of detail; the other groups keep the instancing and the levels of detail, their objects are solved from the whole interval
+    // the objects drawn with the warm start are listed in "warm_start_ids" - false if there are none
+    bool selectWarmStartGroups(unsigned int shader_id, bool ready) {
+        warm_start_ids.clear();
+        for(InstanceGroup& group : instance_groups) {
+            if(group.shader_id != shader_id) continue;
+            group.warm_started = ready && !group.drawn_ids.empty() && group.drawn_ids.size() <= WARM_START_MAX_INSTANCES && group.level_first[1] == group.level_first.back();
+            if(group.warm_started) warm_start_ids.insert(warm_start_ids.end(), group.drawn_ids.begin(), group.drawn_ids.end());
+            // the objects which are not solved in this frame (culled or drawn without the warm start) have too old times to start from when they come back
+            for(unsigned int j : group.object_ids) {
+                if(!group.warm_started || !object_visible[j]) warm_starts[j].invalidate();
+            }
+        }
+        return !warm_start_ids.empty();
+    }
+    
+    // first solve the local times of the objects in "warm_start_ids" (transform feedback, nothing is rasterized), then draw them
+    void drawWarmStart(Camera* camera, WarmStartShaders* variants, unsigned int permutation, float delta_time, const glm::vec3& camera_displacement) {
+        for(unsigned int j : warm_start_ids) {
+            object_buffer.set(j, objectUniforms(camera, objects[j]));
+            object_buffer.upload(j);
+        }
+        
+        const Shader& feedback = variants->feedback.permutation(permutation);
+        const Shader& render = variants->render.permutation(permutation);
+        
+        feedback.use();
+        
+        GLState::setEnabled(GL_RASTERIZER_DISCARD, true);
+        for(unsigned int j : warm_start_ids) {
+            object_buffer.bind(j);
+            
+            float width = 0.0f; // 0 - search the whole interval
+            if(!warm_start_reset && warm_starts[j].isValid()) {
+                SRSolver solver(objects[j].position, objects[j].velocity, glm::vec4(time, camera->position), speed_of_light);
+                width = solver.warmStartWidth(delta_time, camera_displacement);
+            }
+            feedback.setFloat("warm_start_width", width);
+            
+            warm_starts[j].solve(*models[objects[j].model_id]);
+        }
+        GLState::setEnabled(GL_RASTERIZER_DISCARD, false);
+        
+        render.use();
+        
+        for(unsigned int j : warm_start_ids) {
+            object_buffer.bind(j);
+            
+            warm_starts[j].draw(*models[objects[j].model_id], render);
+            processed_vertices += models[objects[j].model_id]->lodVertexCount(0);
+            full_detail_vertices += models[objects[j].model_id]->lodVertexCount(0);
+        }
+    }
+    
+    // the data of the object for the ObjectUniforms block
+    inline ObjectUniforms objectUniforms(Camera* camera, const Object& object) {
+        ObjectUniforms uniforms;
+        uniforms.initial_pos = object.position;
+        uniforms.velocity = object.velocity;
+        uniforms.custom = object.custom_data;
+        
+        SRSolver solver(object.position, object.velocity, glm::vec4(time, camera->position), speed_of_light);
+        uniforms.time_bracket = solver.timeBracket(object.bounding_radius);
+        uniforms.boost = solver.boost();
+        uniforms.gamma = solver.getGamma();
+        uniforms.velocity_sq = solver.getVelocitySq();
+        return uniforms;
     }
     
     void addObject(float pos_x, float pos_y, float pos_z, float v_x, float v_y, float v_z, float c_x = 0, float c_y = 0, float c_z = 0, float c_w = 0) {
@@ -232,8 +676,10 @@ private:
         object.velocity = glm::vec3(v_x, v_y, v_z);
         object.custom_data = glm::mat4(glm::vec4(c_x, c_y, c_z, c_w), glm::vec4(0), glm::vec4(0), glm::vec4(0));
         
-        object.model_id = (unsigned int)(models.size() - 1);
-        object.shader_id = (unsigned int)(shaders.size() - 1);
+        object.model_id = current_model;
+        object.shader_id = current_shader;
+        object.extent_scale = extent_scale;
+        object.extent_offset = extent_offset;
         
         objects.push_back(object);
     }
@@ -244,25 +690,117 @@ private:
         object.velocity = glm::vec3(v_x, v_y, v_z);
         object.custom_data = custom;
         
-        object.model_id = (unsigned int)(models.size() - 1);
-        object.shader_id = (unsigned int)(shaders.size() - 1);
+        object.model_id = current_model;
+        object.shader_id = current_shader;
+        object.extent_scale = extent_scale;
+        object.extent_offset = extent_offset;
         
         objects.push_back(object);
     }
     
     void addModel(const std::string &path) {
-        Model model = Model(path);
-        models.push_back(model);
+        for(current_model = 0; current_model < model_requests.size(); current_model++) {
+            if(model_requests[current_model].path == path && model_requests[current_model].shader_id == current_shader) return;
+        }
+        model_requests.push_back({path, current_shader});
+    }
+    
+    // the vertex formats are read from the code of the shaders, the models are loaded while the driver compiles the programs
+    void acquireModels() {
+        std::vector<unsigned int> model_ids(model_requests.size());
+        for(unsigned int i = 0; i < model_requests.size(); i++) {
+            const Shader& shader = shaders[model_requests[i].shader_id];
+            #ifdef HALF_TEX_COORDS
+            VertexFormat format = VertexFormat::fromSource(shader.vertexCode(), true);
+            #else
+            VertexFormat format = VertexFormat::fromSource(shader.vertexCode(), false);
+            #endif
+            ModelHandle model = model_registry.acquire(model_requests[i].path, format);
+            for(model_ids[i] = 0; model_ids[i] < models.size(); model_ids[i]++) {
+                if(models[model_ids[i]].getId() == model.getId()) break;
+            }
+            if(model_ids[i] == models.size()) models.push_back(model);
+        }
+        for(Object& object : objects) object.model_id = model_ids[object.model_id];
+        model_requests.clear();
     }
     
     void addShader(const char* vertex_path, const char* fragment_path, const char* geometry_path = nullptr) {
         Shader shader = Shader(vertex_path, fragment_path, geometry_path);
+        current_shader = (unsigned int)shaders.size();
         shaders.push_back(shader);
+        warm_start_shader_id.push_back(-1);
+        capture_shader_id.push_back(-1);
     }
     
-    void addRelativisticShader(const char* custom_vertex_fragment = nullptr) {
-        Shader shader = Shader("src/shaders/ray/sr_ray.vs", "src/shaders/ray/sr_ray.fs", custom_vertex_fragment);
+    void addRelativisticShader(const char* custom_vertex_fragment = nullptr, float extent_scale = 1.0f, float extent_offset = 0.0f) {
+        this->extent_scale = extent_scale;
+        this->extent_offset = extent_offset;
+        
+        std::string defines;
+        if(isTimeIndependent(custom_vertex_fragment)) defines += "#define STATIC_LOCAL_SHAPE\n";
+        #ifdef SOLVER_TELEMETRY
+        defines += "#define SOLVER_TELEMETRY\n";
+        #endif
+        
+        // the paths are the same for all the relativistic shaders, so the custom code and the definitions give the source
+        std::string source = defines + (custom_vertex_fragment ? custom_vertex_fragment : "");
+        std::map<std::string, unsigned int>::const_iterator it = relativistic_shader_ids.find(source);
+        if(it != relativistic_shader_ids.end()) {
+            current_shader = it->second;
+            return;
+        }
+        relativistic_shader_ids[source] = current_shader = (unsigned int)shaders.size();
+        
+        Shader shader = Shader("src/shaders/ray/sr_ray.vs", "src/shaders/ray/sr_ray.fs", custom_vertex_fragment, nullptr, defines + "#define INSTANCED\n");
         shaders.push_back(shader);
+        
+        // the vertices solved once per frame and drawn by "apparent_shader", compiled in "compileApparentShaders"
+        capture_shader_id.push_back((int)capture_sources.size());
+        capture_sources.push_back({custom_vertex_fragment != nullptr, custom_vertex_fragment ? custom_vertex_fragment : "", defines});
+        
+        // the analytic solution needs no starting point
+        if(isTimeIndependent(custom_vertex_fragment)) {
+            warm_start_shader_id.push_back(-1);
+            return;
+        }
+        WarmStartShaders variants;
+        variants.feedback = Shader("src/shaders/ray/sr_ray.vs", "src/shaders/ray/sr_ray.fs", custom_vertex_fragment, nullptr, defines + "#define WARM_START\n" + OBJECT_UNIFORMS_GLSL, {"solved_time"});
+        variants.render = Shader("src/shaders/ray/sr_ray.vs", "src/shaders/ray/sr_ray.fs", custom_vertex_fragment, nullptr, defines + "#define SOLVED_TIME\n" + OBJECT_UNIFORMS_GLSL);
+        warm_start_shader_id.push_back((int)warm_start_shaders.size());
+        warm_start_shaders.push_back(variants);
+    }
+    
+    // the shaders of the apparent cache are submitted when it is turned on for the first time, so the scenes which do not use it do not compile them
+    void compileApparentShaders() {
+        if(capture_shaders.size() == capture_sources.size()) return;
+        for(size_t k = capture_shaders.size(); k < capture_sources.size(); k++) {
+            const CaptureSource& source = capture_sources[k];
+            capture_shaders.push_back(Shader("src/shaders/ray/sr_ray.vs", "src/shaders/ray/sr_ray.fs", source.has_custom_vertex_fragment ? source.custom_vertex_fragment.c_str() : nullptr, nullptr, source.defines + "#define INSTANCED\n#define CAPTURE_APPARENT\n", {"solved_vertex", "solved_surface"}));
+        }
+        if(apparent_shader.ID == 0) {
+            std::string apparent_defines = "#define CACHED_APPARENT\n";
+            #ifdef SOLVER_TELEMETRY
+            apparent_defines += "#define SOLVER_TELEMETRY\n";
+            #endif
+            apparent_shader = Shader("src/shaders/ray/sr_apparent.vs", "src/shaders/ray/sr_ray.fs", nullptr, nullptr, apparent_defines);
+        }
+    }
+    
+    // the shape of the object is constant in its own frame if the custom code never reads "t_local"
+    static bool isTimeIndependent(const char* custom_vertex_fragment) {
+        if(!custom_vertex_fragment) return true;
+        
+        const std::string code(custom_vertex_fragment);
+        const std::string key = "t_local";
+        auto is_identifier = [](char c) { return std::isalnum((unsigned char)c) || c == '_'; };
+        
+        for(size_t pos = code.find(key); pos != std::string::npos; pos = code.find(key, pos + 1)) {
+            bool starts = pos == 0 || !is_identifier(code[pos - 1]);
+            bool ends = pos + key.size() == code.size() || !is_identifier(code[pos + key.size()]);
+            if(starts && ends) return false;
+        }
+        return true;
     }
 };
 
@@ -4,6 +4,8 @@
 // More on https://learnopengl.com/About
 //
 // The is a small change in the code in the constructor of Shader, which allows to add a custom piece of code in a vertex shader in a place pointed by "//<->//" in the shader code. The program replaces a line whch contains this key-word with a code given in "custom_vertex_fragment" variable.
+// The preprocessor definitions given in "defines" and the declaration of the uniform blocks (see "uniform_blocks.h") are inserted after the "#version" directive of every stage. A shader can be compiled again with additional definitions ("permutation"), the copies share the program and the permutations - they are deleted with the last copy.
+// The programs are compiled in the background and cached as driver binaries (see "program_cache.h"), "use" waits for the program, "isReady" only asks if it is done.
 //
 
 #ifndef shader_h
@@ -12,18 +14,37 @@
 #include <glad/glad.h>
 #include "glm.hpp"
 
+#include "uniform_blocks.h"
+#include "gl_state.h"
+#include "program_cache.h"
+
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+// permutations of a shader (see "Shader::permutation"), each one compiled with its own definitions
+const unsigned int SHADER_TRUE_POSITION = 1 << 0; // TRUE_POSITION
+const unsigned int SHADER_NO_DOPPLER = 1 << 1; // NO_DOPPLER
+const unsigned int SHADER_TESSELLATED = 1 << 2; // TESSELLATED, the vertex code is compiled also as the tessellation stages (drawn with GL_PATCHES)
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1 // GL_KHR_parallel_shader_compile
+#endif
 
 class Shader {
 public:
-    unsigned int ID;
+    unsigned int ID = 0;
     
     Shader() {}
     
-    Shader(const char* vertexPath, const char* fragmentPath, const char* custom_vertex_fragment = nullptr, const char* geometryPath = nullptr) {
+    Shader(const char* vertexPath, const char* fragmentPath, const char* custom_vertex_fragment = nullptr, const char* geometryPath = nullptr, const std::string& defines = "", const std::vector<const char*>& feedback_varyings = {}) {
         std::string vertexCode;
         std::string fragmentCode;
         std::string geometryCode;
@@ -69,89 +90,297 @@ public:
                 gShaderFile.close();
                 geometryCode = gShaderStream.str();
             }
+            
         } catch(std::ifstream::failure e) {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
         
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
+        // the code is kept for the permutations, which are compiled later
+        std::shared_ptr<Source> code = std::make_shared<Source>();
+        code->vertex = vertexCode;
+        code->fragment = fragmentCode;
+        code->geometry = geometryCode;
+        code->has_geometry = geometryPath != nullptr;
+        code->defines = defines;
+        code->feedback_varyings.assign(feedback_varyings.begin(), feedback_varyings.end());
+        source = code;
+        permutations = std::make_shared<std::map<unsigned int, Shader>>();
         
-        unsigned int vertex, fragment;
-        
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        build(defines);
+    }
+    
+    // the variant of the program compiled with the definitions of "flags" (SHADER_TRUE_POSITION, SHADER_NO_DOPPLER, SHADER_TESSELLATED), compiled the first time it is needed - the copies of the shader share the variants
+    const Shader& permutation(unsigned int flags) const {
+        if(flags & SHADER_TRUE_POSITION) flags |= SHADER_NO_DOPPLER; // the true position is always shown without the Doppler effect
+        if(flags == 0 || !source) return *this;
+        std::shared_ptr<std::map<unsigned int, Shader>> variants = permutations ? permutations : base_permutations.lock();
+        if(!variants) return *this;
         
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        std::map<unsigned int, Shader>::iterator it = variants->find(flags);
+        if(it != variants->end()) return it->second;
         
-        unsigned int geometry;
-        if(geometryPath != nullptr) {
-            const char* gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+        Shader variant;
+        variant.source = source;
+        variant.base_permutations = variants;
+        variant.build(source->defines + permutationDefines(flags), (flags & SHADER_TESSELLATED) != 0);
+        return variants->insert(std::make_pair(flags, variant)).first->second;
+    }
+    
+    // true if the program can be used - with GL_KHR_parallel_shader_compile the driver is asked if it has finished compiling, otherwise it waits for it
+    bool isReady() const {
+        if(!link || link->finished) return true;
+        if(parallelCompile()) {
+            int completed = 0;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+            if(!completed) return false;
         }
+        finish();
+        return true;
+    }
+    
+    // wait for the program to be linked, report the errors and release the stages
+    void finish() const {
+        if(!link || link->finished) return;
+        link->finished = true;
         
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr) glAttachShader(ID, geometry);
-        glLinkProgram(ID);
+        for(const std::pair<unsigned int, std::string>& stage : link->stages) checkCompileErrors(stage.first, stage.second);
         checkCompileErrors(ID, "PROGRAM");
+        for(const std::pair<unsigned int, std::string>& stage : link->stages) {
+            glDetachShader(ID, stage.first);
+            glDeleteShader(stage.first);
+        }
+        link->stages.clear();
         
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr) glDeleteShader(geometry);
+        int success;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if(success) ProgramCache::save(ID, link->key);
+        
+        bindUniformBlock("FrameUniforms", FRAME_UNIFORMS_BINDING);
+        bindUniformBlock("ObjectUniforms", OBJECT_UNIFORMS_BINDING);
+    }
+    
+    void use() const {
+        finish();
+        GLState::useProgram(ID);
+    }
+    
+    // the code of the vertex stage with the custom code, before the definitions are inserted
+    const std::string& vertexCode() const {
+        static const std::string empty;
+        return source ? source->vertex : empty;
     }
     
-    void use() {
-        glUseProgram(ID);
+    // location of the uniform, asked from OpenGL only the first time for the program
+    int location(const std::string &name) const {
+        if(!program) return -1;
+        std::unordered_map<std::string, int>::const_iterator it = program->locations.find(name);
+        if(it != program->locations.end()) return it->second;
+        int uniform_location = glGetUniformLocation(ID, name.c_str());
+        program->locations[name] = uniform_location;
+        return uniform_location;
     }
     
     void setBool(const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(location(name), (int)value);
     }
+    // the values are remembered, so the samplers are not set again for every draw of a mesh
     void setInt(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        int uniform_location = location(name);
+        if(!program) return;
+        std::unordered_map<int, int>::iterator it = program->int_values.find(uniform_location);
+        if(it != program->int_values.end() && it->second == value) {
+            GLState::countElided();
+            return;
+        }
+        program->int_values[uniform_location] = value;
+        GLState::countIssued();
+        glUniform1i(uniform_location, value);
     }
     void setFloat(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(location(name), value);
     }
     void setVec2(const std::string &name, const glm::vec2 &value) const {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(location(name), 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(location(name), x, y);
     }
     void setVec3(const std::string &name, const glm::vec3 &value) const {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(location(name), 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(location(name), x, y, z);
     }
     void setVec4(const std::string &name, const glm::vec4 &value) const {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(location(name), 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(location(name), x, y, z, w);
     }
     void setMat2(const std::string &name, const glm::mat2 &mat) const {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     void setMat3(const std::string &name, const glm::mat3 &mat) const {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     void setMat4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
-    void checkCompileErrors(unsigned int shader, std::string type) {
+    // the code of the stages before the definitions are inserted
+    struct Source {
+        std::string vertex, fragment, geometry;
+        bool has_geometry;
+        std::string defines;
+        std::vector<std::string> feedback_varyings;
+    };
+    
+    std::shared_ptr<const Source> source;
+    std::shared_ptr<std::map<unsigned int, Shader>> permutations; // nullptr in the permutations
+    std::weak_ptr<std::map<unsigned int, Shader>> base_permutations; // the map holding this permutation, it would never be deleted if the permutation owned it
+    
+    // the program shared by the copies of the shader, deleted with the last one - the uniforms belong to the program, so their locations and the values of the integers are kept with it
+    struct Program {
+        unsigned int ID;
+        std::unordered_map<std::string, int> locations;
+        std::unordered_map<int, int> int_values;
+        
+        Program(unsigned int ID) : ID(ID) {}
+        Program(const Program&) = delete;
+        Program& operator=(const Program&) = delete;
+        
+        ~Program() {
+            GLState::forgetProgram(ID);
+            glDeleteProgram(ID);
+        }
+    };
+    
+    std::shared_ptr<Program> program;
+    
+    // the compilation which has not been checked yet, shared by the copies of the shader
+    struct Link {
+        std::vector<std::pair<unsigned int, std::string>> stages; // the stages and their types, deleted after linking
+        std::uint64_t key;
+        bool finished = false;
+        
+        // the stages of a program deleted before it was checked
+        ~Link() {
+            for(const std::pair<unsigned int, std::string>& stage : stages) glDeleteShader(stage.first);
+        }
+    };
+    
+    std::shared_ptr<Link> link;
+    
+    // GLSL 4.1 has no "binding" layout qualifier, the blocks which are not used by the shader are skipped
+    void bindUniformBlock(const char* name, unsigned int binding) const {
+        unsigned int index = glGetUniformBlockIndex(ID, name);
+        if(index != GL_INVALID_INDEX) glUniformBlockBinding(ID, index, binding);
+    }
+    
+    static std::string permutationDefines(unsigned int flags) {
+        std::string defines;
+        if(flags & SHADER_TRUE_POSITION) defines += "#define TRUE_POSITION\n";
+        if(flags & SHADER_NO_DOPPLER) defines += "#define NO_DOPPLER\n";
+        if(flags & SHADER_TESSELLATED) defines += "#define TESSELLATED\n";
+        return defines;
+    }
+    
+    static bool parallelCompile() {
+        static int supported = -1;
+        if(supported < 0) {
+            supported = 0;
+            int count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for(int i = 0; i < count; i++) {
+                const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+                if(extension && (std::strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || std::strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)) supported = 1;
+            }
+        }
+        return supported > 0;
+    }
+    
+    // insert the definitions into the code and create the program (from the cached binary if there is one), the stages are only submitted - the result is checked in "finish"
+    void build(const std::string& defines, bool tessellated = false) {
+        std::string header = defines + FRAME_UNIFORMS_GLSL;
+        std::string vertexCode = insertDefines(source->vertex, header);
+        std::string fragmentCode = insertDefines(source->fragment, header);
+        std::string geometryCode = source->has_geometry ? insertDefines(source->geometry, header) : std::string();
+        std::string tessControlCode = tessellated ? insertDefines(source->vertex, "#define TESS_CONTROL_STAGE\n" + header) : std::string();
+        std::string tessEvaluationCode = tessellated ? insertDefines(source->vertex, "#define TESS_EVALUATION_STAGE\n" + header) : std::string();
+        
+        std::vector<std::string> sources = {vertexCode, fragmentCode, geometryCode, tessControlCode, tessEvaluationCode};
+        sources.insert(sources.end(), source->feedback_varyings.begin(), source->feedback_varyings.end());
+        std::uint64_t key = ProgramCache::key(sources);
+        
+        ID = glCreateProgram();
+        program = std::make_shared<Program>(ID);
+        if(ProgramCache::load(ID, key)) {
+            bindUniformBlock("FrameUniforms", FRAME_UNIFORMS_BINDING);
+            bindUniformBlock("ObjectUniforms", OBJECT_UNIFORMS_BINDING);
+            return;
+        }
+        
+        std::vector<const char*> feedback_varyings;
+        for(const std::string& varying : source->feedback_varyings) feedback_varyings.push_back(varying.c_str());
+        link = std::make_shared<Link>();
+        link->key = key;
+        compile(vertexCode, fragmentCode, source->has_geometry ? &geometryCode : nullptr, tessellated ? &tessControlCode : nullptr, tessellated ? &tessEvaluationCode : nullptr, feedback_varyings);
+    }
+    
+    // compile the stages and link them into the program without waiting for the driver, the driver is asked to keep the binary for "ProgramCache"
+    void compile(const std::string& vertexCode, const std::string& fragmentCode, const std::string* geometryCode, const std::string* tessControlCode, const std::string* tessEvaluationCode, const std::vector<const char*>& feedback_varyings) {
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+        
+        unsigned int vertex, fragment;
+        
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        link->stages.push_back(std::make_pair(vertex, std::string("VERTEX")));
+        
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        link->stages.push_back(std::make_pair(fragment, std::string("FRAGMENT")));
+        
+        unsigned int geometry;
+        if(geometryCode != nullptr) {
+            const char* gShaderCode = geometryCode->c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+            link->stages.push_back(std::make_pair(geometry, std::string("GEOMETRY")));
+        }
+        
+        if(tessControlCode != nullptr) link->stages.push_back(std::make_pair(compileStage(GL_TESS_CONTROL_SHADER, *tessControlCode), std::string("TESS_CONTROL")));
+        if(tessEvaluationCode != nullptr) link->stages.push_back(std::make_pair(compileStage(GL_TESS_EVALUATION_SHADER, *tessEvaluationCode), std::string("TESS_EVALUATION")));
+
+        for(const std::pair<unsigned int, std::string>& stage : link->stages) glAttachShader(ID, stage.first);
+        if(!feedback_varyings.empty()) glTransformFeedbackVaryings(ID, (GLsizei)feedback_varyings.size(), feedback_varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        if(ProgramCache::isSupported()) glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+    }
+
+    static unsigned int compileStage(GLenum type, const std::string& code) {
+        const char* shaderCode = code.c_str();
+        unsigned int stage = glCreateShader(type);
+        glShaderSource(stage, 1, &shaderCode, NULL);
+        glCompileShader(stage);
+        return stage;
+    }
+    
+    // "#version" has to be the first directive of the shader, so the definitions are placed in the line after it
+    static std::string insertDefines(const std::string& code, const std::string& defines) {
+        size_t version = code.find("#version");
+        if(version == std::string::npos) return defines + code;
+        size_t line_end = code.find('\n', version);
+        if(line_end == std::string::npos) return code + "\n" + defines;
+        return code.substr(0, line_end + 1) + defines + code.substr(line_end + 1);
+    }
+    
+    static void checkCompileErrors(unsigned int shader, std::string type) {
         int success;
         char infoLog[1024];
         
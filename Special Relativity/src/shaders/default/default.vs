@@ -4,7 +4,7 @@ layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
-uniform mat4 PV;
+// PV is in the FrameUniforms block inserted by "shader.h"
 uniform mat4 model;
 
 void main() {
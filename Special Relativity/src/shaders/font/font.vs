@@ -2,10 +2,10 @@
 layout (location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
 out vec2 TexCoords;
 
-uniform mat4 projection;
+// screen_projection is in the FrameUniforms block inserted by "shader.h"
 
 void main()
 {
-    gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
+    gl_Position = screen_projection * vec4(vertex.xy, 0.0, 1.0);
     TexCoords = vertex.zw;
 }  
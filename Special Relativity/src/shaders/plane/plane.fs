@@ -3,7 +3,7 @@ out vec4 FragColor;
 
 in vec3 FragPosition;
 
-uniform vec3 camera_position;
+// camera is in the FrameUniforms block inserted by "shader.h"
 
 const float spacing = 0.5f;
 const float width = 0.01f;
@@ -11,8 +11,8 @@ const float width_thick = 0.03f;
 const float fade = 0.0005f;
 
 void main() {
-    float x = (FragPosition+camera_position).x;
-    float z = (FragPosition+camera_position).z;
+    float x = (FragPosition+camera.yzw).x;
+    float z = (FragPosition+camera.yzw).z;
     float radius_2 = FragPosition.x*FragPosition.x+FragPosition.z*FragPosition.z;
     float m_x = mod(x+spacing, spacing*2);
     float m_z = mod(z+spacing, spacing*2);
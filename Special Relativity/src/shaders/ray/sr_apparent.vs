@@ -0,0 +1,36 @@
+#version 410 core
+// draws the vertices solved in this frame by the CAPTURE_APPARENT variant of "sr_ray.vs" (see "apparent_geometry.h") - the light cone equation is not solved again, so every pass drawing the objects costs only this
+// PV is in the FrameUniforms block inserted by "shader.h"
+
+// the instance attributes of "sr_ray.vs" (see "instance_buffer.h") - only the ones needed for the Doppler effect, calculated per fragment in "sr_ray.fs"
+layout (location = 7) in vec4 aVelocity; // xyz - velocity
+layout (location = 12) in mat4 aBoost; // gamma is aBoost[0][0]
+
+// two texels for every solved vertex: xyz - position (IN S FRAME, relative to the camera); xy - texture coordinates, z - number of iterations
+uniform samplerBuffer apparent_geometry;
+uniform int apparent_first; // the texel of the first vertex of the drawn instances
+uniform int apparent_points; // the number of the vertices of one instance (the indices of the mesh point to them, see "Mesh::preparePointLevels")
+
+out vec3 Normal;
+out vec2 TexCoords;
+out vec3 FragmentPos;
+flat out vec3 velocity;
+flat out float gamma;
+#ifdef SOLVER_TELEMETRY
+out float solver_iterations;
+#endif
+
+void main() {
+    int texel = apparent_first + 2*(gl_InstanceID*apparent_points + gl_VertexID);
+    vec4 position = texelFetch(apparent_geometry, texel);
+    vec4 surface = texelFetch(apparent_geometry, texel + 1);
+
+    FragmentPos = position.xyz;
+    velocity = aVelocity.xyz;
+    gamma = aBoost[0][0];
+    TexCoords = surface.xy;
+#ifdef SOLVER_TELEMETRY
+    solver_iterations = surface.z;
+#endif
+    gl_Position = PV * vec4(FragmentPos, 1.0);
+}
@@ -4,17 +4,22 @@ out vec4 FragColor;
 in vec3 Normal;
 in vec2 TexCoords;
 
-in float velocity_sq;
 in vec3 FragmentPos;
+#ifdef SOLVER_TELEMETRY
+in float solver_iterations;
 
-uniform sampler2D texture_diffuse1;
+const float TELEMETRY_ITERATIONS = 40.0f; // number of iterations shown in red, no iterations are shown in green
+#endif
 
-uniform vec4 camera;
-uniform vec3 velocity;
-uniform float speed_of_light;
+uniform sampler2D texture_diffuse1;
 
-uniform bool show_true_position; //if false - show apparent position and doppler effect, if true - show true position (with light propagation speed taken to be infinite) and turn off doppler
-uniform bool turn_off_doppler; //if false - apply doppler effect, if true - turn off doppler effect
+// speed_of_light is in the FrameUniforms block inserted by "shader.h"
+// TRUE_POSITION or NO_DOPPLER - the variant drawing the original colors (no Doppler shift), chosen by "Shader::permutation"
+#if defined(INSTANCED) || defined(CACHED_APPARENT)
+flat in vec3 velocity; // velocity of the drawn instance (CACHED_APPARENT - read by "sr_apparent.vs" from the same instance attributes)
+flat in float gamma;
+#endif
+// otherwise velocity and gamma are in the ObjectUniforms block inserted by "scene.h"
 
 //wavelengths of light
 const float R = 700.0f;
@@ -35,7 +40,7 @@ const vec3 violet = vec3(0.38f, 0.004f, 0.424f); //390
 
 float dopplerShift(float lambda) {
     float angle_times_speed = dot(velocity, normalize(FragmentPos));
-    return lambda / sqrt(1.0f - velocity_sq/(speed_of_light * speed_of_light)) * (1.0f + angle_times_speed/speed_of_light);
+    return lambda * gamma * (1.0f + angle_times_speed/speed_of_light);
 }
 
 vec3 interpolate(vec3 col1, vec3 col2, float low, float high, float val) {
@@ -66,6 +71,13 @@ vec3 transformColor(vec3 color) {
 }
 
 void main() {
-    if(!show_true_position && !turn_off_doppler) FragColor = vec4(transformColor(texture(texture_diffuse1, TexCoords).xyz), 1.0f);
-    else FragColor = texture(texture_diffuse1, TexCoords);
+#ifdef SOLVER_TELEMETRY
+    FragColor = vec4(mix(green, red, clamp(solver_iterations/TELEMETRY_ITERATIONS, 0.0f, 1.0f)), 1.0f);
+#else
+#if defined(TRUE_POSITION) || defined(NO_DOPPLER)
+    FragColor = texture(texture_diffuse1, TexCoords);
+#else
+    FragColor = vec4(transformColor(texture(texture_diffuse1, TexCoords).xyz), 1.0f);
+#endif
+#endif
 }
@@ -1,30 +1,132 @@
 #version 410 core
+// TESSELLATED - the variant drawn as patches, the same code is also compiled as the tessellation control stage (TESS_CONTROL_STAGE) and the tessellation evaluation stage (TESS_EVALUATION_STAGE), so every stage has the solver with the custom code (see "Shader::permutation")
+// the control stage splits the edges whose apparent midpoint is further than TESSELLATION_PIXEL_ERROR pixels from the middle of their chord (the straight edges look curved because of the aberration and the Terrell rotation), the evaluation stage solves the position of every new vertex
+#if defined(TESS_CONTROL_STAGE) || defined(TESS_EVALUATION_STAGE)
+#define TESS_STAGE
+#endif
+
+#ifdef TESS_STAGE
+// the attributes of the vertex being solved, set from the patch
+vec3 aPos;
+vec4 aInitialPos;
+vec4 aVelocity;
+mat4 aCustom;
+mat4 aBoost;
+vec4 aTimeBracket;
+#else
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#endif
+#if defined(WARM_START) || defined(SOLVED_TIME)
+// x component - local time found in the transform feedback pass (in the previous frame for WARM_START, in this frame for SOLVED_TIME), y component - number of iterations it took
+layout (location = 5) in vec2 aSolvedTime;
+#endif
+#if defined(INSTANCED) && !defined(TESS_STAGE)
+// data of the object drawn by this instance, set once in "scene.h" (the instanced variant replaces the per-object uniforms)
+layout (location = 6) in vec4 aInitialPos; // xyz - initial_pos, w - bounding radius of the object (not read here)
+layout (location = 7) in vec4 aVelocity; // xyz - velocity, w - velocity_sq
+layout (location = 8) in mat4 aCustom; // uses locations 8-11
+layout (location = 12) in mat4 aBoost; // uses locations 12-15, gamma is aBoost[0][0]
+layout (location = 4) in vec4 aTimeBracket; // updated every frame, the mesh sends no bitangents to this shader (see "instance_buffer.h")
+#endif
+
+#ifdef TESSELLATED
+const float TESSELLATION_PIXEL_ERROR = 1.0f;
+const float TESSELLATION_MAX_LEVEL = 16.0f;
+#if defined(TESS_CONTROL_STAGE)
+layout (vertices = 3) out;
+#elif defined(TESS_EVALUATION_STAGE)
+layout (triangles, equal_spacing, ccw) in;
+#endif
+// a vertex of the patch - the vertex shader solves the corners, the control stage passes them on
+#ifdef TESS_STAGE
+in TessVertex {
+    vec3 local_position; // aPos
+    vec3 position; // solved position (FragmentPos)
+    vec2 tex_coords;
+    float iterations;
+    vec4 instance_pos; // the instance attributes, without the boost
+    vec4 instance_velocity;
+    mat4 instance_custom;
+    vec4 instance_bracket;
+} tess_in[];
+#endif
+// the boost does not fit in the outputs of the vertex shader, so the control stage calculates it once per patch and passes it on
+#if defined(TESS_CONTROL_STAGE)
+patch out mat4 patch_boost;
+#elif defined(TESS_EVALUATION_STAGE)
+patch in mat4 patch_boost;
+#endif
+#ifndef TESS_EVALUATION_STAGE
+out TessVertex {
+    vec3 local_position;
+    vec3 position;
+    vec2 tex_coords;
+    float iterations;
+    vec4 instance_pos;
+    vec4 instance_velocity;
+    mat4 instance_custom;
+    vec4 instance_bracket;
+#ifdef TESS_CONTROL_STAGE
+} tess_out[];
+#else
+} tess_out;
+#endif
+#endif
+#endif
 
+#ifndef TESS_CONTROL_STAGE
 out vec3 Normal;
 out vec2 TexCoords;
 out vec3 FragmentPos;
-out float velocity_sq;
-
-uniform mat4 PV;
-
-// x component - time at which the camera is observing (t_c), yzw components - position of the camera at this time (r_c) (IN S FRAME)
-uniform vec4 camera;
-
-uniform bool show_true_position; //if false - show apparent position, if true - show true position (with light propagation speed taken to be infinite)
+#ifdef SOLVER_TELEMETRY
+out float solver_iterations;
+#endif
+#endif
+#ifdef WARM_START
+out vec2 solved_time; // captured by the transform feedback, the same layout as aSolvedTime
+#endif
+#ifdef CAPTURE_APPARENT
+// captured by the transform feedback and drawn by "sr_apparent.vs" in every pass of the frame (see "apparent_geometry.h")
+out vec4 solved_vertex; // xyz - FragmentPos
+out vec4 solved_surface; // xy - TexCoords, z - number of iterations
+#endif
 
-uniform vec3 initial_pos; // position of the object (r_0) at time (t = 0) (IN S FRAME)
-uniform vec3 velocity; // velocity of the object
-uniform mat4 custom; // hold custom data to be use at "pos_local" function, it's use is specified in "scene.h"
+// PV, camera (x component - time at which the camera is observing (t_c), yzw components - position of the camera at this time (r_c) (IN S FRAME)), speed_of_light and c_2_inv (1/c^2) are in the FrameUniforms block inserted by "shader.h"
+// TRUE_POSITION - the variant showing the true positions of the vertices (at the time of the camera) instead of the apparent ones, chosen by "Shader::permutation"
 
-uniform float speed_of_light;
+#ifdef INSTANCED
+// the same variables as in the ObjectUniforms block, set in "set_instance" - velocity and gamma are also needed by the fragment shader for the Doppler effect
+vec3 initial_pos;
+#ifdef TESS_CONTROL_STAGE
+vec3 velocity;
+float gamma;
+#else
+flat out vec3 velocity;
+flat out float gamma;
+#endif
+mat4 custom;
+mat4 boost;
+float velocity_sq;
+vec4 time_bracket;
+#else
+// the data of the object is in the ObjectUniforms block inserted by "scene.h":
+// initial_pos - position of the object (r_0) at time (t = 0) (IN S FRAME), velocity - velocity of the object, custom - custom data used in "pos_local" function, it's use is specified in "scene.h"
+// invariants of the object calculated once per object in "scene.h": boost - Lorentz boost from S' frame to S frame, acting on (t', r'), gamma, velocity_sq
+// time_bracket: xy - interval containing (t_c') of every vertex of the object, zw - interval containing (t_c'(MAX)) of every vertex, both calculated from the bounding radius of the object
+#endif
+#ifdef WARM_START
+// how far (t_c') can move since the previous frame, if 0 - the previous solution cannot be used (calculated in "scene.h")
+uniform float warm_start_width;
+#endif
 
-const float PRECISION = 0;
-const int ITERATION_MAX = 1000;
+const float TIME_PRECISION = 1e-4; // the light travels 0.1mm (if 1 unit = 1m) in this time - far below the size of a pixel
+const int ITERATION_MAX = 100;
 const float MAX_TIME_DISTANCE = 2000;
 
+// number of evaluations of the equations used for this vertex
+int iterations = 0;
+
 // rotate a vector by a specified angle around a specified axis
 mat3 rotate(in vec3 axis, float angle) {
     mat3 rot;
@@ -50,15 +152,8 @@ vec3 pos_local(float t_local) {
 }
 // gives 4-position of the vertex (IN S FRAME) at a given time (t')
 vec4 lorentz_transform(float t_local) {
-    vec4 transform;
-    float v_dot_r_local = dot(pos_local(t_local), velocity);
-    float c_2_inv = 1/(speed_of_light*speed_of_light);
-    float gamma = 1/sqrt(1-velocity_sq*c_2_inv);
-
-    float t_observer = gamma*(t_local+v_dot_r_local*c_2_inv);
-    vec3 pos_observer = pos_local(t_local) + velocity*((gamma-1)*v_dot_r_local/velocity_sq+gamma*t_local) + initial_pos - camera.yzw;
-    transform.x = t_observer;
-    transform.yzw = pos_observer;
+    vec4 transform = boost * vec4(t_local, pos_local(t_local));
+    transform.yzw += initial_pos - camera.yzw;
     return transform;
 }
 // sets the eqution to find the time (t_c') at which light was emitted to reach the camera at (t_c, r_c)
@@ -71,60 +166,234 @@ float equation(float t_local) {
 // sets the eqution to find the time maximum possible time (t_c'(MAX)) at which the light could be emitted to reach the camera at (t_c, r_c)
 float boudary_equation(float t_local) {
     float v_dot_r_local = dot(pos_local(t_local), velocity);
-    float c_2_inv = 1/(speed_of_light*speed_of_light);
-    float gamma = 1/sqrt(1-velocity_sq*c_2_inv);
-
     return gamma*(t_local+v_dot_r_local*c_2_inv) - camera.x;
 }
-// solve the equation to find (t_c'(MAX)) using regula-falsi method
-float find_boundary() {
-    float inf = MAX_TIME_DISTANCE;
-    float start = -inf, end = inf;
-    float c;
-    float a_prev, b_prev;
-    int counter = 0;
-    do {
-        a_prev = start;
-        b_prev = end;
-        float f_a = boudary_equation(start), f_b = boudary_equation(end);
-        c = (start*f_b-end*f_a)/(f_b - f_a);
-        float f_c = boudary_equation(c);
-        if(f_c == 0) break;
-        if(f_c*f_a > 0) start = c;
-        else end = c;
-        counter++;
-    } while(counter < ITERATION_MAX && c-a_prev > PRECISION && b_prev-c > PRECISION);
-    return c;
+// evaluate the equation solved by "find_boundary" (boundary = true) or by "solve" (boundary = false)
+float solved_equation(bool boundary, float t_local) {
+    return boundary ? boudary_equation(t_local) : equation(t_local);
 }
-// solve the equation to find (t_c') using regula-falsi method
-float solve(float start, float end) {
-    float c;
-    float a_prev, b_prev;
-    int counter = 0;
-    do {
-        a_prev = start;
-        b_prev = end;
-        float f_a = equation(start), f_b = equation(end);
+// solve the equation on [start, end] using the Illinois variant of regula-falsi - if the same end of the interval is kept twice in a row, the value of the function at the other end is halved, so the method does not stall on one side of the root
+float illinois(bool boundary, float start, float end, float f_a, float f_b) {
+    float c = 0.5f*(start+end);
+    int side = 0;
+    for(int counter = 0; counter < ITERATION_MAX && end - start > TIME_PRECISION; counter++) {
         c = (start*f_b-end*f_a)/(f_b - f_a);
-        float f_c = equation(c);
+        if(!(c > start && c < end)) c = 0.5f*(start+end); // also catches f_b == f_a
+        if(!(c > start && c < end)) break; // the interval cannot be divided any further in float precision
+        float f_c = solved_equation(boundary, c);
+        iterations++;
         if(f_c == 0) break;
-        if(f_c*f_a > 0) start = c;
-        else end = c;
-        counter++;
-    } while(counter < ITERATION_MAX && c-a_prev > PRECISION && b_prev-c > PRECISION);
+        if(f_c*f_a > 0) {
+            start = c;
+            f_a = f_c;
+            if(side == -1) f_b *= 0.5f;
+            side = -1;
+        } else {
+            end = c;
+            f_b = f_c;
+            if(side == 1) f_a *= 0.5f;
+            side = 1;
+        }
+    }
     return c;
 }
+// solve the equation in the bracket given by the CPU - if it does not contain the root (the custom code moves the vertex further than expected), fall back to the wide interval [start, end]
+float bracketed(bool boundary, vec2 bracket, float start, float end) {
+    float f_a = solved_equation(boundary, bracket.x), f_b = solved_equation(boundary, bracket.y);
+    if(bracket.x < bracket.y && f_a*f_b <= 0) return illinois(boundary, bracket.x, bracket.y, f_a, f_b);
+    return illinois(boundary, start, end, solved_equation(boundary, start), solved_equation(boundary, end));
+}
+// solve the equation to find (t_c'(MAX))
+float find_boundary() {
+    return bracketed(true, time_bracket.zw, -MAX_TIME_DISTANCE, MAX_TIME_DISTANCE);
+}
+// solve the equation to find (t_c'), the light cannot be emitted after (t_c'(MAX))
+float solve(float t_camera_local_max) {
+#ifdef WARM_START
+    // start from the narrow interval around the solution from the previous frame
+    if(warm_start_width > 0) {
+        vec2 warm_bracket = vec2(aSolvedTime.x-warm_start_width, min(aSolvedTime.x+warm_start_width, t_camera_local_max));
+        float f_a = equation(warm_bracket.x), f_b = equation(warm_bracket.y);
+        if(warm_bracket.x < warm_bracket.y && f_a*f_b <= 0) return illinois(false, warm_bracket.x, warm_bracket.y, f_a, f_b);
+    }
+#endif
+    return bracketed(false, vec2(time_bracket.x, min(time_bracket.y, t_camera_local_max)), t_camera_local_max-MAX_TIME_DISTANCE, t_camera_local_max);
+}
+// S-frame time (t) at which the light reaching the camera was emitted by a point moving with the object, which is at pos_0 (relative to the camera) at t = 0 - the same as "findTime" in "scene.h"
+float emission_time(vec3 pos_0) {
+    // alpha = -pos_0/c, beta = v/c
+    float beta_2 = 1-velocity_sq*c_2_inv;
+    float alpha_2 = dot(pos_0, pos_0)*c_2_inv;
+    float adb = camera.x+dot(pos_0, velocity)*c_2_inv; // adb - dot product of alpha and beta
+    // smaller root of the quadratic, written so that it stays finite when beta_2 goes to 0
+    return (camera.x*camera.x-alpha_2)/(adb+sqrt(adb*adb+beta_2*(alpha_2-camera.x*camera.x)));
+}
+#ifdef STATIC_LOCAL_SHAPE
+// if the object does not change its shape, the world line of the vertex is straight (x(t) = x_0 + v*t IN S FRAME) and the equation becomes a quadratic
+vec3 analytic_position() {
+    vec3 r_local = pos_local(0.0f);
+    // position of the vertex at t = 0 relative to the camera, contracted in the direction of motion
+    vec3 pos_0 = r_local - velocity*(gamma/(gamma+1)*c_2_inv*dot(r_local, velocity)) + initial_pos - camera.yzw;
+#ifdef TRUE_POSITION
+    return pos_0 + velocity*camera.x;
+#else
+    return pos_0 + velocity*emission_time(pos_0);
+#endif
+}
+#endif
+#if defined(TESS_CONTROL_STAGE) || defined(PER_VERTEX_INVARIANTS)
+// the same as "boost" in "sr_solver.h"
+mat4 lorentz_boost(vec3 v, float v_sq) {
+    float g = 1/sqrt(1-v_sq*c_2_inv);
+    float contraction = v_sq > 0 ? (g-1)/v_sq : 0.0f;
+    mat4 b;
+    b[0] = vec4(g, g*v);
+    for(int i = 0; i < 3; i++) {
+        vec3 column = contraction*v[i]*v;
+        column[i] += 1.0f;
+        b[i+1] = vec4(g*v[i]*c_2_inv, column);
+    }
+    return b;
+}
+#endif
+#ifdef INSTANCED
+// read the object from the instance attributes - the invariants are calculated once per object in "scene.h", the time bracket once per object and frame
+void set_instance() {
+    initial_pos = aInitialPos.xyz;
+    velocity = aVelocity.xyz;
+    custom = aCustom;
+#ifdef PER_VERTEX_INVARIANTS
+    // the invariants calculated for every vertex, as before they were moved to "scene.h" - only used by "Benchmark::benchmarkInvariants"
+    velocity_sq = dot(velocity, velocity);
+    boost = lorentz_boost(velocity, velocity_sq);
+#else
+    velocity_sq = aVelocity.w;
+    boost = aBoost;
+#endif
+    gamma = boost[0][0];
+    time_bracket = aTimeBracket;
+}
+#endif
+#ifndef SOLVED_TIME
+// the position (x(t)) of the vertex "aPos" (IN S FRAME, relative to the camera) seen by the camera
+vec3 apparent_position() {
+#ifdef STATIC_LOCAL_SHAPE
+    return analytic_position();
+#else
+    // calculate (t_c'(MAX))
+    float t_camera_local_max = find_boundary();
+#ifdef TRUE_POSITION
+    float t_local = t_camera_local_max;
+#else
+    float t_local = solve(t_camera_local_max);
+#endif
+#ifdef WARM_START
+    solved_time = vec2(t_local, float(iterations));
+#endif
+    return lorentz_transform(t_local).yzw;
+#endif
+}
+#endif
+#ifdef TESS_STAGE
+// take the instance attributes from the patch
+void set_patch_instance() {
+    aInitialPos = tess_in[0].instance_pos;
+    aVelocity = tess_in[0].instance_velocity;
+    aCustom = tess_in[0].instance_custom;
+    aTimeBracket = tess_in[0].instance_bracket;
+#ifdef TESS_CONTROL_STAGE
+    aBoost = lorentz_boost(aVelocity.xyz, aVelocity.w);
+    patch_boost = aBoost;
+#else
+    aBoost = patch_boost;
+#endif
+    set_instance();
+}
+#endif
+
+#if defined(TESS_CONTROL_STAGE)
+// number of the segments of the edge, so its apparent curve stays within TESSELLATION_PIXEL_ERROR pixels from the chords - symmetric in the ends, so both patches sharing the edge split it the same way
+float edge_level(int a, int b) {
+    aPos = 0.5f*(tess_in[a].local_position + tess_in[b].local_position);
+    vec4 curve = PV * vec4(apparent_position(), 1.0);
+    vec4 chord = PV * vec4(0.5f*(tess_in[a].position + tess_in[b].position), 1.0);
+    if(curve.w <= 0.0f || chord.w <= 0.0f) return 1.0f; // behind the camera - clipped anyway
+    float deviation = length((curve.xy/curve.w - chord.xy/chord.w)*0.5f*viewport);
+    // the distance of a smooth curve from its chords falls with the square of the number of the segments
+    return clamp(ceil(sqrt(deviation/TESSELLATION_PIXEL_ERROR)), 1.0f, TESSELLATION_MAX_LEVEL);
+}
+void main() {
+    tess_out[gl_InvocationID].local_position = tess_in[gl_InvocationID].local_position;
+    tess_out[gl_InvocationID].position = tess_in[gl_InvocationID].position;
+    tess_out[gl_InvocationID].tex_coords = tess_in[gl_InvocationID].tex_coords;
+    tess_out[gl_InvocationID].iterations = tess_in[gl_InvocationID].iterations;
+    tess_out[gl_InvocationID].instance_pos = tess_in[gl_InvocationID].instance_pos;
+    tess_out[gl_InvocationID].instance_velocity = tess_in[gl_InvocationID].instance_velocity;
+    tess_out[gl_InvocationID].instance_custom = tess_in[gl_InvocationID].instance_custom;
+    tess_out[gl_InvocationID].instance_bracket = tess_in[gl_InvocationID].instance_bracket;
+
+    if(gl_InvocationID == 0) {
+        set_patch_instance();
+        // the outer level i belongs to the edge opposite to the vertex i
+        gl_TessLevelOuter[0] = edge_level(1, 2);
+        gl_TessLevelOuter[1] = edge_level(2, 0);
+        gl_TessLevelOuter[2] = edge_level(0, 1);
+        gl_TessLevelInner[0] = max(gl_TessLevelOuter[0], max(gl_TessLevelOuter[1], gl_TessLevelOuter[2]));
+    }
+}
+#elif defined(TESS_EVALUATION_STAGE)
+void main() {
+    vec3 weights = gl_TessCoord;
+    set_patch_instance();
+    TexCoords = weights.x*tess_in[0].tex_coords + weights.y*tess_in[1].tex_coords + weights.z*tess_in[2].tex_coords;
+
+    // the corners have already been solved by the vertex shader
+    int corner = weights.x == 1.0f ? 0 : (weights.y == 1.0f ? 1 : (weights.z == 1.0f ? 2 : -1));
+    if(corner >= 0) {
+        FragmentPos = tess_in[corner].position;
+        iterations = int(tess_in[corner].iterations);
+    } else {
+        aPos = weights.x*tess_in[0].local_position + weights.y*tess_in[1].local_position + weights.z*tess_in[2].local_position;
+        FragmentPos = apparent_position();
+    }
+    gl_Position = PV * vec4(FragmentPos, 1.0);
+#ifdef SOLVER_TELEMETRY
+    solver_iterations = float(iterations);
+#endif
+}
+#else
 // main program
 void main() {
     TexCoords = aTexCoords;
+#ifdef INSTANCED
+    set_instance();
+#endif
 
-    // calculate velocity_sq for the fragment shader
-    velocity_sq = dot(velocity, velocity);
-    // calculate (t_c'(MAX))
-    float t_camera_local_max = find_boundary();
-    // calculate the position (x(t)) of the vertex (IN S FRAME) and send it to the fragment shader
-    if(!show_true_position)
-        FragmentPos = lorentz_transform(solve(t_camera_local_max-MAX_TIME_DISTANCE, t_camera_local_max)).yzw;
-    else FragmentPos = lorentz_transform(t_camera_local_max).yzw;
+#ifdef SOLVED_TIME
+    // the equation has already been solved in the transform feedback pass
+    FragmentPos = lorentz_transform(aSolvedTime.x).yzw;
+    iterations = int(aSolvedTime.y);
+#else
+    // calculate the position of the vertex and send it to the fragment shader
+    FragmentPos = apparent_position();
+#endif
     gl_Position = PV * vec4(FragmentPos, 1.0);
+#ifdef SOLVER_TELEMETRY
+    solver_iterations = float(iterations);
+#endif
+#ifdef CAPTURE_APPARENT
+    solved_vertex = vec4(FragmentPos, 1.0f);
+    solved_surface = vec4(aTexCoords, float(iterations), 0.0f);
+#endif
+#ifdef TESSELLATED
+    tess_out.local_position = aPos;
+    tess_out.position = FragmentPos;
+    tess_out.tex_coords = aTexCoords;
+    tess_out.iterations = float(iterations);
+    tess_out.instance_pos = aInitialPos;
+    tess_out.instance_velocity = aVelocity;
+    tess_out.instance_custom = aCustom;
+    tess_out.instance_bracket = aTimeBracket;
+#endif
 }
+#endif
@@ -0,0 +1,442 @@
+//
+//  sr_solver.h
+//  Special Relativity
+//
+//  CPU reference implementation of the retarded-time solver used in "src/shaders/ray/sr_ray.vs". The functions mirror the shader one to one (lorentz_transform, equation, boudary_equation, illinois, find_boundary, solve), so the hottest part of the program can be profiled and checked without a GPU context. "Benchmark::checkShader" (run with "--benchmark") compares the results with the shader, so the two cannot drift apart unnoticed. The same notation as in the presentation is used.
+//
+//  *** "SRSolver(initial_pos, velocity, camera, speed_of_light)":
+//  - holds the uniforms of one object, exactly as they are sent to the shader by "Scene".
+//
+//  *** "apparentPosition(pos_local, show_true_position)":
+//  - solves a single vertex, "pos_local" is any callable "glm::vec3(float t_local)" - the C++ equivalent of the custom GLSL fragment.
+//
+//  *** "analyticPosition(r_local, show_true_position)":
+//  - the closed-form solution used by the shader for the objects which do not change their shape (STATIC_LOCAL_SHAPE).
+//
+//  *** "timeBracket(bounding_radius)":
+//  - the narrow intervals searched by the solver, sent to the shader as "time_bracket" - use "setTimeBracket" to make the CPU solver use them as well.
+//
+//  *** "warmStartWidth(time_step, camera_displacement)":
+//  - half-width of the interval around the local time from the previous frame, searched first by the WARM_START variant of the shader.
+//
+//  *** "solveBatch(vertices, result, show_true_position)":
+//  - solves a whole array of vertices stored as structure-of-arrays. It assumes that the object does not change its shape in its own frame (pos_local returns aPos). Uses AVX2 or SSE if the compiler targets them, otherwise falls back to a scalar loop.
+//
+//  The GPU evaluates the same floating point expressions, but the drivers are free to use faster (less accurate) sqrt and division, so the positions are only expected to match within SR_SOLVER_TOLERANCE (relative to the distance from the camera).
+//
+
+#ifndef sr_solver_h
+#define sr_solver_h
+
+#include "glm.hpp"
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the constants have to be the same as in "sr_ray.vs"
+const float SR_SOLVER_TIME_PRECISION = 1e-4f;
+const int SR_SOLVER_ITERATION_MAX = 100;
+const float SR_SOLVER_MAX_TIME_DISTANCE = 2000;
+
+// maximal relative difference between the CPU and the GPU results
+const float SR_SOLVER_TOLERANCE = 1e-3f;
+
+// positions of the vertices in the local frame of the object (S' FRAME), each array holds "count" values
+struct VertexBatch {
+    const float* x;
+    const float* y;
+    const float* z;
+    size_t count;
+};
+
+// apparent positions of the vertices relative to the camera (IN S FRAME), the local times (t_c') at which the light was emitted and optionally the number of evaluations of the equations for each vertex
+struct ApparentBatch {
+    float* x;
+    float* y;
+    float* z;
+    float* t_local;
+    float* iterations = nullptr;
+};
+
+// pos_local of an object which does not change its shape in its own frame
+struct StaticPosition {
+    glm::vec3 a_pos;
+    StaticPosition(const glm::vec3& a_pos) : a_pos(a_pos) {}
+    inline glm::vec3 operator()(float) const {
+        return a_pos;
+    }
+};
+
+// scalar lanes - used by the fallback path and to handle the remainder of the batch
+struct ScalarLanes {
+    typedef float type;
+    typedef bool mask;
+    static const int width = 1;
+
+    static inline type load(const float* p) { return *p; }
+    static inline void store(float* p, type a) { *p = a; }
+    static inline type set(float a) { return a; }
+    static inline type add(type a, type b) { return a + b; }
+    static inline type sub(type a, type b) { return a - b; }
+    static inline type mul(type a, type b) { return a * b; }
+    static inline type div(type a, type b) { return a / b; }
+    static inline type sqrt(type a) { return std::sqrt(a); }
+    static inline mask greater(type a, type b) { return a > b; }
+    static inline mask equal(type a, type b) { return a == b; }
+    static inline mask both(mask a, mask b) { return a && b; }
+    static inline mask firstOnly(mask a, mask b) { return a && !b; }
+    static inline mask all() { return true; }
+    static inline type select(mask m, type a, type b) { return m ? a : b; }
+    static inline bool any(mask m) { return m; }
+};
+
+#if defined(__AVX2__)
+struct SIMDLanes {
+    typedef __m256 type;
+    typedef __m256 mask;
+    static const int width = 8;
+
+    static inline type load(const float* p) { return _mm256_loadu_ps(p); }
+    static inline void store(float* p, type a) { _mm256_storeu_ps(p, a); }
+    static inline type set(float a) { return _mm256_set1_ps(a); }
+    static inline type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static inline type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    static inline type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    static inline type div(type a, type b) { return _mm256_div_ps(a, b); }
+    static inline type sqrt(type a) { return _mm256_sqrt_ps(a); }
+    static inline mask greater(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline mask equal(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static inline mask both(mask a, mask b) { return _mm256_and_ps(a, b); }
+    static inline mask firstOnly(mask a, mask b) { return _mm256_andnot_ps(b, a); }
+    static inline mask all() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static inline type select(mask m, type a, type b) { return _mm256_blendv_ps(b, a, m); }
+    static inline bool any(mask m) { return _mm256_movemask_ps(m) != 0; }
+};
+#elif defined(__SSE2__)
+struct SIMDLanes {
+    typedef __m128 type;
+    typedef __m128 mask;
+    static const int width = 4;
+
+    static inline type load(const float* p) { return _mm_loadu_ps(p); }
+    static inline void store(float* p, type a) { _mm_storeu_ps(p, a); }
+    static inline type set(float a) { return _mm_set1_ps(a); }
+    static inline type add(type a, type b) { return _mm_add_ps(a, b); }
+    static inline type sub(type a, type b) { return _mm_sub_ps(a, b); }
+    static inline type mul(type a, type b) { return _mm_mul_ps(a, b); }
+    static inline type div(type a, type b) { return _mm_div_ps(a, b); }
+    static inline type sqrt(type a) { return _mm_sqrt_ps(a); }
+    static inline mask greater(type a, type b) { return _mm_cmpgt_ps(a, b); }
+    static inline mask equal(type a, type b) { return _mm_cmpeq_ps(a, b); }
+    static inline mask both(mask a, mask b) { return _mm_and_ps(a, b); }
+    static inline mask firstOnly(mask a, mask b) { return _mm_andnot_ps(b, a); }
+    static inline mask all() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static inline type select(mask m, type a, type b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static inline bool any(mask m) { return _mm_movemask_ps(m) != 0; }
+};
+#else
+typedef ScalarLanes SIMDLanes;
+#endif
+
+class SRSolver {
+private:
+    glm::vec3 initial_pos;
+    glm::vec3 velocity;
+    glm::vec4 camera;
+    float speed_of_light;
+
+    float velocity_sq;
+    float c_2_inv;
+    float gamma;
+    float contraction; // (gamma-1)/velocity_sq, with the limit of 0 for the objects at rest
+
+    glm::mat4 boost_matrix; // the same as the "boost" uniform of the shader
+    glm::vec4 time_bracket; // the same as the "time_bracket" uniform of the shader
+
+    // the same method running independently on every lane, the lanes which have converged are masked out
+    template<typename L, typename Function>
+    static typename L::type illinoisLanes(const Function& f, typename L::type start, typename L::type end, typename L::type f_a, typename L::type f_b, typename L::type& iterations) {
+        typedef typename L::type V;
+        typedef typename L::mask M;
+        const V zero = L::set(0.0f), one = L::set(1.0f), half = L::set(0.5f), precision = L::set(SR_SOLVER_TIME_PRECISION);
+
+        V c = L::mul(half, L::add(start, end));
+        V side = zero;
+        M active = L::greater(L::sub(end, start), precision);
+        for(int counter = 0; counter < SR_SOLVER_ITERATION_MAX && L::any(active); counter++) {
+            V c_new = L::div(L::sub(L::mul(start, f_b), L::mul(end, f_a)), L::sub(f_b, f_a));
+            M inside = L::both(L::greater(c_new, start), L::greater(end, c_new));
+            c_new = L::select(inside, c_new, L::mul(half, L::add(start, end)));
+            c = L::select(active, c_new, c);
+            active = L::both(active, L::both(L::greater(c_new, start), L::greater(end, c_new)));
+
+            V f_c = f(c);
+            iterations = L::select(active, L::add(iterations, one), iterations);
+
+            M moving = L::firstOnly(active, L::equal(f_c, zero));
+            M move_start = L::greater(L::mul(f_c, f_a), zero);
+            M to_start = L::both(moving, move_start), to_end = L::firstOnly(moving, move_start);
+            f_b = L::select(L::both(to_start, L::greater(zero, side)), L::mul(half, f_b), f_b);
+            f_a = L::select(L::both(to_end, L::greater(side, zero)), L::mul(half, f_a), f_a);
+            start = L::select(to_start, c, start);
+            f_a = L::select(to_start, f_c, f_a);
+            end = L::select(to_end, c, end);
+            f_b = L::select(to_end, f_c, f_b);
+            side = L::select(to_start, L::sub(zero, one), L::select(to_end, one, side));
+
+            active = L::both(moving, L::greater(L::sub(end, start), precision));
+        }
+        return c;
+    }
+
+    template<typename L, typename Function>
+    static typename L::type bracketedLanes(const Function& f, typename L::type bracket_start, typename L::type bracket_end, typename L::type start, typename L::type end, typename L::type& iterations) {
+        typedef typename L::type V;
+        typedef typename L::mask M;
+        V f_a = f(bracket_start), f_b = f(bracket_end);
+        M valid = L::both(L::greater(bracket_end, bracket_start), L::firstOnly(L::all(), L::greater(L::mul(f_a, f_b), L::set(0.0f))));
+        start = L::select(valid, bracket_start, start);
+        end = L::select(valid, bracket_end, end);
+        f_a = L::select(valid, f_a, f(start));
+        f_b = L::select(valid, f_b, f(end));
+        return illinoisLanes<L>(f, start, end, f_a, f_b, iterations);
+    }
+
+    // S-frame time (t) at which the light reaching the camera left the point which was at "pos_0" (relative to the camera) at t = 0 and moves with the velocity of the object
+    float emissionTime(const glm::vec3& pos_0) const {
+        glm::vec3 alpha = -pos_0/speed_of_light;
+        glm::vec3 beta = velocity/speed_of_light;
+        float beta_2 = 1-glm::dot(beta, beta);
+        float alpha_2 = glm::dot(alpha, alpha);
+        float adb = camera.x-glm::dot(alpha, beta);
+        return (camera.x*camera.x-alpha_2)/(adb+std::sqrt(adb*adb+beta_2*(alpha_2-camera.x*camera.x)));
+    }
+
+    // solve the vertices [begin, end) of the batch using given lanes
+    template<typename L>
+    void solveLanes(const VertexBatch& vertices, const ApparentBatch& result, bool show_true_position, size_t begin, size_t end) const {
+        typedef typename L::type V;
+        const V v_x = L::set(velocity.x), v_y = L::set(velocity.y), v_z = L::set(velocity.z);
+        const V offset_x = L::set(initial_pos.x - camera.y), offset_y = L::set(initial_pos.y - camera.z), offset_z = L::set(initial_pos.z - camera.w);
+        const V gamma_l = L::set(gamma), c_2_inv_l = L::set(c_2_inv), contraction_l = L::set(contraction);
+        const V c_l = L::set(speed_of_light), t_c = L::set(camera.x), max_time = L::set(SR_SOLVER_MAX_TIME_DISTANCE);
+        const V bracket_x = L::set(time_bracket.x), bracket_y = L::set(time_bracket.y), bracket_z = L::set(time_bracket.z), bracket_w = L::set(time_bracket.w);
+
+        for(size_t i = begin; i + L::width <= end; i += L::width) {
+            const V p_x = L::load(vertices.x + i), p_y = L::load(vertices.y + i), p_z = L::load(vertices.z + i);
+            const V v_dot_r_local = L::add(L::add(L::mul(p_x, v_x), L::mul(p_y, v_y)), L::mul(p_z, v_z));
+            const V t_shift = L::mul(v_dot_r_local, c_2_inv_l);
+            const V r_shift = L::mul(contraction_l, v_dot_r_local);
+
+            auto boundary_equation = [&](V t_local) {
+                return L::sub(L::mul(gamma_l, L::add(t_local, t_shift)), t_c);
+            };
+            auto position = [&](V t_local, V& x, V& y, V& z) {
+                V k = L::add(r_shift, L::mul(gamma_l, t_local));
+                x = L::add(L::add(p_x, L::mul(v_x, k)), offset_x);
+                y = L::add(L::add(p_y, L::mul(v_y, k)), offset_y);
+                z = L::add(L::add(p_z, L::mul(v_z, k)), offset_z);
+            };
+            auto equation = [&](V t_local) {
+                V x, y, z;
+                position(t_local, x, y, z);
+                V t_observer = L::mul(gamma_l, L::add(t_local, t_shift));
+                V rhs = L::sqrt(L::add(L::add(L::mul(x, x), L::mul(y, y)), L::mul(z, z)));
+                return L::sub(L::mul(c_l, L::sub(t_c, t_observer)), rhs);
+            };
+
+            V iterations = L::set(0.0f);
+            V t_local = bracketedLanes<L>(boundary_equation, bracket_z, bracket_w, L::set(-SR_SOLVER_MAX_TIME_DISTANCE), max_time, iterations);
+            if(!show_true_position) {
+                V bracket_end = L::select(L::greater(bracket_y, t_local), t_local, bracket_y);
+                t_local = bracketedLanes<L>(equation, bracket_x, bracket_end, L::sub(t_local, max_time), t_local, iterations);
+            }
+
+            V x, y, z;
+            position(t_local, x, y, z);
+            L::store(result.x + i, x);
+            L::store(result.y + i, y);
+            L::store(result.z + i, z);
+            L::store(result.t_local + i, t_local);
+            if(result.iterations) L::store(result.iterations + i, iterations);
+        }
+    }
+
+public:
+    // Illinois variant of regula-falsi method, identical to "illinois" in the shader
+    template<typename Function>
+    static float illinois(const Function& f, float start, float end, float f_a, float f_b, int& iterations) {
+        float c = 0.5f*(start+end);
+        int side = 0;
+        for(int counter = 0; counter < SR_SOLVER_ITERATION_MAX && end - start > SR_SOLVER_TIME_PRECISION; counter++) {
+            c = (start*f_b-end*f_a)/(f_b - f_a);
+            if(!(c > start && c < end)) c = 0.5f*(start+end);
+            if(!(c > start && c < end)) break;
+            float f_c = f(c);
+            iterations++;
+            if(f_c == 0) break;
+            if(f_c*f_a > 0) {
+                start = c;
+                f_a = f_c;
+                if(side == -1) f_b *= 0.5f;
+                side = -1;
+            } else {
+                end = c;
+                f_b = f_c;
+                if(side == 1) f_a *= 0.5f;
+                side = 1;
+            }
+        }
+        return c;
+    }
+
+    // identical to "bracketed" in the shader
+    template<typename Function>
+    static float bracketed(const Function& f, const glm::vec2& bracket, float start, float end, int& iterations) {
+        float f_a = f(bracket.x), f_b = f(bracket.y);
+        if(bracket.x < bracket.y && f_a*f_b <= 0) return illinois(f, bracket.x, bracket.y, f_a, f_b, iterations);
+        return illinois(f, start, end, f(start), f(end), iterations);
+    }
+
+    SRSolver(const glm::vec3& initial_pos, const glm::vec3& velocity, const glm::vec4& camera, float speed_of_light) : initial_pos(initial_pos), velocity(velocity), camera(camera), speed_of_light(speed_of_light) {
+        velocity_sq = glm::dot(velocity, velocity);
+        c_2_inv = 1/(speed_of_light*speed_of_light);
+        gamma = 1/std::sqrt(1-velocity_sq*c_2_inv);
+        contraction = velocity_sq > 0.0f ? (gamma-1)/velocity_sq : 0.0f;
+        boost_matrix = boost();
+        time_bracket = glm::vec4(-SR_SOLVER_MAX_TIME_DISTANCE, SR_SOLVER_MAX_TIME_DISTANCE, -SR_SOLVER_MAX_TIME_DISTANCE, SR_SOLVER_MAX_TIME_DISTANCE);
+    }
+
+    // S-frame time (t) at which the light reaching the camera was emitted by the origin of the object - the same as "findTime" in "scene.h"
+    float originTime() const {
+        return emissionTime(initial_pos - glm::vec3(camera.y, camera.z, camera.w));
+    }
+
+    // Gives the intervals of local times which contain (t_c') (xy) and (t_c'(MAX)) (zw) of every vertex within "bounding_radius" from the origin of the object. At S-frame time t every such vertex lies within bounding_radius from the origin (the contraction only makes it closer), so its light can reach the camera at most bounding_radius/(c-|v|) before or after the light of the origin. Local times of simultaneous events (IN S FRAME) differ from t/gamma by at most |v|*bounding_radius/c^2.
+    glm::vec4 timeBracket(float bounding_radius) const {
+        float speed = std::sqrt(velocity_sq);
+        float t_0 = originTime();
+        float spread = bounding_radius/(speed_of_light - speed);
+        float t_shift = speed*bounding_radius*c_2_inv;
+        float margin = 10.0f*SR_SOLVER_TIME_PRECISION + 1e-5f*(std::abs(t_0) + std::abs(camera.x));
+
+        float boundary_start = camera.x/gamma - t_shift - margin;
+        float boundary_end = camera.x/gamma + t_shift + margin;
+        float start = glm::max((t_0 - spread)/gamma - t_shift - margin, boundary_start - SR_SOLVER_MAX_TIME_DISTANCE);
+        float end = glm::min(glm::min(t_0 + spread, camera.x)/gamma + t_shift + margin, boundary_end);
+        return glm::vec4(start, end, boundary_start, boundary_end);
+    }
+
+    void setTimeBracket(const glm::vec4& bracket) {
+        time_bracket = bracket;
+    }
+
+    // How far the local time (t_c') of a vertex can move between two frames, if the camera time changes by "time_step" and the camera moves by "camera_displacement". The emission time (IN S FRAME) moves at most (|dt_c| + |dr_c|/c)*c/(c-|v|) and the local time runs gamma times slower along the world line. The motion of the vertex in its own frame is not included - if it is faster, the shader falls back to "time_bracket".
+    float warmStartWidth(float time_step, const glm::vec3& camera_displacement) const {
+        float speed = std::sqrt(velocity_sq);
+        float shift = (std::abs(time_step) + glm::length(camera_displacement)/speed_of_light)*speed_of_light/(speed_of_light - speed)/gamma;
+        return 1.1f*shift + 10.0f*SR_SOLVER_TIME_PRECISION;
+    }
+
+    // the invariants of the object sent to the shader as uniforms, so they are not recalculated for every vertex
+    inline float getGamma() const {
+        return gamma;
+    }
+
+    inline float getVelocitySq() const {
+        return velocity_sq;
+    }
+
+    inline float getC2Inv() const {
+        return c_2_inv;
+    }
+
+    // Lorentz boost from S' frame to S frame, acting on (t', r')
+    glm::mat4 boost() const {
+        glm::mat4 matrix;
+        matrix[0] = glm::vec4(gamma, gamma*velocity);
+        for(int i = 0; i < 3; i++) {
+            glm::vec3 column = contraction*velocity[i]*velocity;
+            column[i] += 1.0f;
+            matrix[i+1] = glm::vec4(gamma*velocity[i]*c_2_inv, column);
+        }
+        return matrix;
+    }
+
+    // gives 4-position of the vertex (IN S FRAME) at a given time (t'), the position is relative to the camera
+    template<typename PosLocal>
+    glm::vec4 lorentzTransform(const PosLocal& pos_local, float t_local) const {
+        glm::vec4 transform = boost_matrix * glm::vec4(t_local, pos_local(t_local));
+        return transform + glm::vec4(0.0f, initial_pos - glm::vec3(camera.y, camera.z, camera.w));
+    }
+
+    // the eqution to find the time (t_c') at which light was emitted to reach the camera at (t_c, r_c)
+    template<typename PosLocal>
+    float equation(const PosLocal& pos_local, float t_local) const {
+        glm::vec4 vec4_at_t_local = lorentzTransform(pos_local, t_local);
+        float LHS = speed_of_light*(camera.x - vec4_at_t_local.x);
+        float RHS = glm::length(glm::vec3(vec4_at_t_local.y, vec4_at_t_local.z, vec4_at_t_local.w));
+        return LHS - RHS;
+    }
+
+    // the eqution to find the maximum possible time (t_c'(MAX)) at which the light could be emitted to reach the camera at (t_c, r_c)
+    template<typename PosLocal>
+    float boundaryEquation(const PosLocal& pos_local, float t_local) const {
+        float v_dot_r_local = glm::dot(pos_local(t_local), velocity);
+        return gamma*(t_local+v_dot_r_local*c_2_inv) - camera.x;
+    }
+
+    template<typename PosLocal>
+    float findBoundary(const PosLocal& pos_local, int& iterations) const {
+        return bracketed([&](float t) { return boundaryEquation(pos_local, t); }, glm::vec2(time_bracket.z, time_bracket.w), -SR_SOLVER_MAX_TIME_DISTANCE, SR_SOLVER_MAX_TIME_DISTANCE, iterations);
+    }
+
+    template<typename PosLocal>
+    float solve(const PosLocal& pos_local, float t_camera_local_max, int& iterations) const {
+        return bracketed([&](float t) { return equation(pos_local, t); }, glm::vec2(time_bracket.x, glm::min(time_bracket.y, t_camera_local_max)), t_camera_local_max-SR_SOLVER_MAX_TIME_DISTANCE, t_camera_local_max, iterations);
+    }
+
+    // the equivalent of "main" in the vertex shader - gives the position of the vertex relative to the camera (IN S FRAME)
+    template<typename PosLocal>
+    glm::vec3 apparentPosition(const PosLocal& pos_local, bool show_true_position, float* t_local = nullptr, int* iterations = nullptr) const {
+        int counter = 0;
+        float t_camera_local_max = findBoundary(pos_local, counter);
+        float t = show_true_position ? t_camera_local_max : solve(pos_local, t_camera_local_max, counter);
+        if(t_local) *t_local = t;
+        if(iterations) *iterations = counter;
+        glm::vec4 transform = lorentzTransform(pos_local, t);
+        return glm::vec3(transform.y, transform.z, transform.w);
+    }
+
+    // the equivalent of "analytic_position" in the vertex shader - the world line of a vertex with a constant local position is straight, so the light cone equation is a quadratic
+    glm::vec3 analyticPosition(const glm::vec3& r_local, bool show_true_position) const {
+        glm::vec3 pos_0 = r_local - velocity*(gamma/(gamma+1)*c_2_inv*glm::dot(r_local, velocity)) + initial_pos - glm::vec3(camera.y, camera.z, camera.w);
+        return pos_0 + velocity*(show_true_position ? camera.x : emissionTime(pos_0));
+    }
+    
+    // solve all the vertices of the batch, the arrays in "result" have to be able to hold "vertices.count" values
+    void solveBatch(const VertexBatch& vertices, const ApparentBatch& result, bool show_true_position) const {
+        size_t simd_end = vertices.count - vertices.count % SIMDLanes::width;
+        solveLanes<SIMDLanes>(vertices, result, show_true_position, 0, simd_end);
+        solveLanes<ScalarLanes>(vertices, result, show_true_position, simd_end, vertices.count);
+    }
+};
+
+// largest difference between two results, relative to the distance from the camera (compare with SR_SOLVER_TOLERANCE)
+inline float maxRelativeDeviation(const ApparentBatch& a, const ApparentBatch& b, size_t count) {
+    float deviation = 0.0f;
+    for(size_t i = 0; i < count; i++) {
+        glm::vec3 pos_a(a.x[i], a.y[i], a.z[i]), pos_b(b.x[i], b.y[i], b.z[i]);
+        float scale = glm::max(glm::length(pos_a), 1.0f);
+        deviation = glm::max(deviation, glm::length(pos_a - pos_b)/scale);
+    }
+    return deviation;
+}
+
+#endif /* sr_solver_h */
@@ -0,0 +1,128 @@
+//
+//  texture_registry.h
+//  Special Relativity
+//
+//  Textures shared by all the models of the program. A texture is found by the resolved path of its file or by the hash of its content (both filled by "Model::import"), so the models referencing the same image (even under a different path) use one texture. The textures are reference counted - the last "release" deletes the texture.
+//  Used only on the thread of the OpenGL context.
+//
+//  *** "TextureRegistry::acquire(reference, create)":
+//  - returns the texture of the reference, "create" is called only if the image has not been loaded before.
+//
+//  *** "TextureRegistry::savedBytes()":
+//  - estimated GPU memory (with the mipmaps) which the shared textures would take if every model loaded its own copy.
+//
+
+#ifndef texture_registry_h
+#define texture_registry_h
+
+#include <glad/glad.h>
+
+#include "mesh.h"
+#include "gl_state.h"
+
+#include <cstdint>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+class TextureRegistry {
+private:
+    struct Entry {
+        unsigned int references;
+        size_t bytes;
+        std::string file;
+        std::uint64_t hash;
+    };
+
+    struct Registry {
+        std::unordered_map<unsigned int, Entry> entries; // by the name of the texture
+        std::unordered_map<std::string, unsigned int> by_file;
+        std::unordered_map<std::uint64_t, unsigned int> by_content;
+        size_t used_bytes = 0, saved_bytes = 0;
+    };
+
+    static Registry& registry() {
+        static Registry texture_registry;
+        return texture_registry;
+    }
+
+    static unsigned int find(const TextureReference& reference) {
+        Registry& r = registry();
+        std::unordered_map<std::string, unsigned int>::const_iterator file = r.by_file.find(reference.file);
+        if(file != r.by_file.end()) return file->second;
+        if(reference.hash == 0) return 0; // the file could not be read, only the path identifies it
+        std::unordered_map<std::uint64_t, unsigned int>::const_iterator content = r.by_content.find(reference.hash);
+        if(content != r.by_content.end()) {
+            r.by_file[reference.file] = content->second;
+            return content->second;
+        }
+        return 0;
+    }
+
+public:
+    static unsigned int acquire(const TextureReference& reference, const std::function<unsigned int()>& create) {
+        Registry& r = registry();
+        unsigned int texture = find(reference);
+        if(texture != 0) {
+            Entry& entry = r.entries[texture];
+            entry.references++;
+            r.saved_bytes += entry.bytes;
+            return texture;
+        }
+
+        texture = create();
+        Entry entry;
+        entry.references = 1;
+        entry.bytes = reference.bytes;
+        entry.file = reference.file;
+        entry.hash = reference.hash;
+        r.entries[texture] = entry;
+        r.by_file[reference.file] = texture;
+        if(reference.hash != 0) r.by_content[reference.hash] = texture;
+        r.used_bytes += reference.bytes;
+        return texture;
+    }
+
+    static void release(unsigned int texture) {
+        Registry& r = registry();
+        std::unordered_map<unsigned int, Entry>::iterator it = r.entries.find(texture);
+        if(it == r.entries.end()) return;
+        Entry& entry = it->second;
+        if(--entry.references > 0) {
+            r.saved_bytes -= entry.bytes;
+            return;
+        }
+
+        // every path which led to the texture
+        for(std::unordered_map<std::string, unsigned int>::iterator file = r.by_file.begin(); file != r.by_file.end();) {
+            if(file->second == texture) file = r.by_file.erase(file);
+            else ++file;
+        }
+        if(entry.hash != 0) r.by_content.erase(entry.hash);
+        r.used_bytes -= entry.bytes;
+        r.entries.erase(it);
+
+        GLState::forgetTexture(texture);
+        glDeleteTextures(1, &texture);
+    }
+
+    // the number of the models using the texture, 0 if it is not in the registry
+    static inline unsigned int references(unsigned int texture) {
+        std::unordered_map<unsigned int, Entry>::const_iterator it = registry().entries.find(texture);
+        return it == registry().entries.end() ? 0 : it->second.references;
+    }
+
+    static inline unsigned int textureCount() {
+        return (unsigned int)registry().entries.size();
+    }
+
+    static inline size_t usedBytes() {
+        return registry().used_bytes;
+    }
+
+    static inline size_t savedBytes() {
+        return registry().saved_bytes;
+    }
+};
+
+#endif /* texture_registry_h */
@@ -0,0 +1,176 @@
+//
+//  texture_streamer.h
+//  Special Relativity
+//
+//  Loads the textures in the background, so the scene can be shown before they are ready. A requested texture starts as a 1x1 grey placeholder, the image is decoded on a worker thread and then copied to a pixel buffer object a few rows at a time - every frame copies at most the given number of bytes, so a large texture does not stall a frame.
+//  The placeholder stays until the last row is in the buffer, then the texture is specified from the buffer at once and the mipmaps are generated - the texture is never sampled with missing rows.
+//
+//  *** "request(filename)":
+//  - creates the texture with the placeholder and starts decoding the image. Returns the name of the texture, which stays the same when the image is loaded.
+//
+//  *** "update(budget)":
+//  - called once per frame on the thread of the OpenGL context, uploads at most "budget" bytes of the decoded images (at least one row).
+//
+//  *** "cancel(texture)":
+//  - stops streaming the image of the texture, called before the texture is deleted (its name can be generated again for another texture).
+//
+
+#ifndef texture_streamer_h
+#define texture_streamer_h
+
+#include <glad/glad.h>
+
+#include "model.h"
+#include "thread_pool.h"
+#include "gl_state.h"
+
+#include <cstring>
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+
+// bytes of the textures uploaded per frame
+const size_t TEXTURE_STREAMING_BUDGET = 4 * 1024 * 1024;
+
+class TextureStreamer {
+private:
+    struct Upload {
+        unsigned int texture;
+        std::shared_ptr<Image> image;
+        int next_row = 0; // rows [0, next_row) are in the PBO
+        bool cancelled = false; // set only on the thread of the OpenGL context
+    };
+
+    std::mutex mutex;
+    std::deque<std::shared_ptr<Upload>> decoded; // written by the workers
+    std::deque<std::shared_ptr<Upload>> uploading; // used only on the thread of the OpenGL context
+    std::unordered_map<unsigned int, std::shared_ptr<Upload>> streaming; // by the name of the texture, until the image is specified
+
+    unsigned int PBO = 0;
+
+    ThreadPool pool; // destroyed first - the tasks left in it still add to "decoded"
+
+    static void setPlaceholder(unsigned int texture) {
+        const unsigned char grey[4] = {128, 128, 128, 255};
+        GLState::bindTexture(0, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // the storage of the PBO for the whole image - the previous image has been specified from it already, so the old storage is orphaned without waiting
+    void allocate(const Upload& upload) {
+        const Image& image = *upload.image;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (size_t)image.width * image.components * image.height, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // copy the next rows of the image to the PBO, returns the number of bytes copied
+    size_t uploadRows(Upload& upload, size_t budget) {
+        const Image& image = *upload.image;
+        size_t row_size = (size_t)image.width * image.components;
+        int rows = (int)std::max<size_t>(1, budget / row_size);
+        rows = std::min(rows, image.height - upload.next_row);
+        size_t size = rows * row_size;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        glBufferSubData(GL_PIXEL_UNPACK_BUFFER, upload.next_row * row_size, size, image.data + upload.next_row * row_size);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        upload.next_row += rows;
+        return size;
+    }
+
+    // replace the placeholder with the image in the PBO
+    void finish(const Upload& upload) {
+        const Image& image = *upload.image;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        GLState::bindTexture(0, upload.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, image.format(), image.width, image.height, 0, image.format(), GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+
+public:
+    TextureStreamer() {
+        glGenBuffers(1, &PBO);
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    ~TextureStreamer() {
+        glDeleteBuffers(1, &PBO);
+    }
+
+    unsigned int request(const std::string& filename) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        setPlaceholder(texture);
+
+        std::shared_ptr<Upload> upload = std::make_shared<Upload>();
+        upload->texture = texture;
+        upload->image = std::make_shared<Image>();
+        streaming[texture] = upload;
+        pool.enqueue([this, upload, filename]() {
+            decodeImage(filename, *upload->image);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(upload);
+        });
+        return texture;
+    }
+
+    // the worker may still be decoding the image - the upload is dropped when it reaches "update"
+    void cancel(unsigned int texture) {
+        std::unordered_map<unsigned int, std::shared_ptr<Upload>>::iterator it = streaming.find(texture);
+        if(it == streaming.end()) return;
+        it->second->cancelled = true;
+        streaming.erase(it);
+    }
+
+    void update(size_t budget = TEXTURE_STREAMING_BUDGET) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while(!decoded.empty()) {
+                uploading.push_back(decoded.front());
+                decoded.pop_front();
+            }
+        }
+        if(uploading.empty()) return;
+
+        // the rows of the images are packed tightly
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        size_t sent = 0;
+        while(!uploading.empty() && sent < budget) {
+            Upload& upload = *uploading.front();
+            if(upload.cancelled) {
+                uploading.pop_front();
+                continue;
+            }
+            if(!upload.image->data) { // the placeholder stays (the error is reported by "decodeImage")
+                streaming.erase(upload.texture);
+                uploading.pop_front();
+                continue;
+            }
+
+            if(upload.next_row == 0) allocate(upload);
+            sent += uploadRows(upload, budget - sent);
+            if(upload.next_row == upload.image->height) {
+                finish(upload);
+                streaming.erase(upload.texture);
+                uploading.pop_front();
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+};
+
+#endif /* texture_streamer_h */
@@ -0,0 +1,77 @@
+//
+//  thread_pool.h
+//  Special Relativity
+//
+//  A fixed number of worker threads (one per core) running the tasks from a shared queue. The tasks must not call OpenGL - the context belongs to the main thread.
+//
+//  *** "enqueue(task)":
+//  - adds the task to the queue, it is run by the first free worker.
+//
+//  The destructor runs the tasks left in the queue and joins the workers.
+//
+
+#ifndef thread_pool_h
+#define thread_pool_h
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <utility>
+
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_added;
+    bool stopping = false;
+
+    void work() {
+        while(true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                task_added.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if(tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    ThreadPool(unsigned int thread_count = std::thread::hardware_concurrency()) {
+        if(thread_count == 0) thread_count = 1;
+        for(unsigned int i = 0; i < thread_count; i++) workers.emplace_back(&ThreadPool::work, this);
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        task_added.notify_all();
+        for(std::thread& worker : workers) worker.join();
+    }
+
+    inline unsigned int size() const {
+        return (unsigned int)workers.size();
+    }
+
+    void enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        task_added.notify_one();
+    }
+};
+
+#endif /* thread_pool_h */
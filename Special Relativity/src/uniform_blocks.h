@@ -0,0 +1,144 @@
+//
+//  uniform_blocks.h
+//  Special Relativity
+//
+//  Uniform blocks (std140) shared by the shaders. Every block is described once by a list of members - the same list generates the C++ struct and the GLSL declaration, which "shader.h" inserts into the shaders, so the two layouts cannot drift apart.
+//  The C++ members are aligned the same way as in std140 (vec3, vec4 and mat4 - 16 bytes, vec2 - 8 bytes, float and bool - 4 bytes), so the structs can be copied to the buffers directly. Only these types can be used (no arrays and no mat3).
+//
+//  *** "FrameUniforms" (binding FRAME_UNIFORMS_BINDING):
+//  - the state of the frame, written once per frame by "Scene" and read by all the shaders (relativistic, default, plane, font).
+//
+//  *** "ObjectUniforms" (binding OBJECT_UNIFORMS_BINDING):
+//  - the data of one object drawn without instancing - the data of all the objects is kept in one buffer, a range of it is bound before each object is drawn.
+//
+//  *** "UniformBuffer<Block>(binding, count)":
+//  - a buffer holding "count" blocks, aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+//
+
+#ifndef uniform_blocks_h
+#define uniform_blocks_h
+
+#include <glad/glad.h>
+#include "glm.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// C++ types with the std140 alignment of the GLSL types
+#define STD140_float float
+#define STD140_bool std::int32_t
+#define STD140_vec2 alignas(8) glm::vec2
+#define STD140_vec3 alignas(16) glm::vec3
+#define STD140_vec4 alignas(16) glm::vec4
+#define STD140_mat4 alignas(16) glm::mat4
+
+#define STD140_CPP_MEMBER(type, name) STD140_##type name;
+#define STD140_GLSL_MEMBER(type, name) "    " #type " " #name ";\n"
+
+#define FRAME_UNIFORMS(MEMBER) \
+    MEMBER(mat4, PV) /* projection * view of the camera */ \
+    MEMBER(mat4, screen_projection) /* orthographic projection of the GUI */ \
+    MEMBER(vec4, camera) /* x - time of the camera (t_c), yzw - position of the camera (r_c) (IN S FRAME) */ \
+    MEMBER(float, speed_of_light) \
+    MEMBER(float, c_2_inv) /* 1/c^2 */ \
+    MEMBER(vec2, viewport) /* size of the viewport in pixels */
+
+#define OBJECT_UNIFORMS(MEMBER) \
+    MEMBER(mat4, boost) /* Lorentz boost from S' frame to S frame */ \
+    MEMBER(mat4, custom) /* custom data of the object used in "pos_local" */ \
+    MEMBER(vec4, time_bracket) /* intervals searched by the solver */ \
+    MEMBER(vec3, initial_pos) \
+    MEMBER(float, gamma) \
+    MEMBER(vec3, velocity) \
+    MEMBER(float, velocity_sq)
+
+const unsigned int FRAME_UNIFORMS_BINDING = 0;
+const unsigned int OBJECT_UNIFORMS_BINDING = 1;
+
+struct FrameUniforms {
+    FRAME_UNIFORMS(STD140_CPP_MEMBER)
+};
+
+struct ObjectUniforms {
+    OBJECT_UNIFORMS(STD140_CPP_MEMBER)
+};
+
+static_assert(sizeof(FrameUniforms) % 16 == 0, "std140 blocks are padded to 16 bytes");
+static_assert(sizeof(ObjectUniforms) % 16 == 0, "std140 blocks are padded to 16 bytes");
+
+// declarations inserted into the shaders (the members are accessed without the block name)
+const char* const FRAME_UNIFORMS_GLSL = "layout (std140) uniform FrameUniforms {\n" FRAME_UNIFORMS(STD140_GLSL_MEMBER) "};\n";
+const char* const OBJECT_UNIFORMS_GLSL = "layout (std140) uniform ObjectUniforms {\n" OBJECT_UNIFORMS(STD140_GLSL_MEMBER) "};\n";
+
+template<typename Block>
+class UniformBuffer {
+private:
+    unsigned int UBO = 0;
+    unsigned int binding;
+    size_t stride;
+    std::vector<unsigned char> data;
+
+public:
+    UniformBuffer(unsigned int binding, size_t count = 1) : binding(binding) {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (sizeof(Block) + alignment - 1) / alignment * alignment;
+        data.resize(stride * (count > 0 ? count : 1));
+
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, data.size(), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        if(count == 1) glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+    }
+
+    // the buffer belongs to the OpenGL context, so the object can only be moved
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    UniformBuffer(UniformBuffer&& other) noexcept : UBO(other.UBO), binding(other.binding), stride(other.stride), data(std::move(other.data)) {
+        other.UBO = 0;
+    }
+
+    UniformBuffer& operator=(UniformBuffer&& other) noexcept {
+        if(this != &other) {
+            if(UBO) glDeleteBuffers(1, &UBO);
+            UBO = other.UBO;
+            binding = other.binding;
+            stride = other.stride;
+            data = std::move(other.data);
+            other.UBO = 0;
+        }
+        return *this;
+    }
+
+    ~UniformBuffer() {
+        if(UBO) glDeleteBuffers(1, &UBO);
+    }
+
+    inline size_t size() const {
+        return data.size() / stride;
+    }
+
+    // copy the block to the CPU copy of the buffer, it is sent to the GPU by "upload"
+    inline void set(size_t index, const Block& block) {
+        std::memcpy(&data[index * stride], &block, sizeof(Block));
+    }
+
+    // send the blocks [first, first + count) to the GPU
+    void upload(size_t first = 0, size_t count = 1) {
+        if(count == 0) return;
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, first * stride, (count - 1) * stride + sizeof(Block), &data[first * stride]);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // make the shaders read the block at "index"
+    inline void bind(size_t index = 0) const {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, UBO, index * stride, sizeof(Block));
+    }
+};
+
+#endif /* uniform_blocks_h */
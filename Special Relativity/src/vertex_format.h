@@ -0,0 +1,146 @@
+//
+//  vertex_format.h
+//  Special Relativity
+//
+//  Layout of the vertices in the vertex buffer of a mesh. The CPU keeps the full "Vertex" (56 bytes), but only the attributes read by the shader of the mesh are sent to the GPU, optionally quantized - e.g. the relativistic shader reads only the position and the texture coordinates, which take 16 bytes with half-float coordinates.
+//  The position (location 0) is always sent as 3 floats. The other attributes keep their locations (1 - normal, 2 - texture coordinates, 3 - tangent, 4 - bitangent), a shader reading an attribute which was not sent gets the default value (0, 0, 0, 1).
+//
+//  *** "VertexFormat::fromSource(vertex_code, half_tex_coords)":
+//  - the format with the attributes declared in the code of the vertex shader ("layout (location = N) in type name;"), found without waiting for the program to be compiled. The declarations are read regardless of the preprocessor conditions, so a shader should not declare the attributes it never reads. If "aNormal" is declared as vec2, the normals are octahedral-packed into 2 x 16-bit snorm - the shader decodes them with:
+//    vec3 n = vec3(aNormal, 1.0 - abs(aNormal.x) - abs(aNormal.y)); if(n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * sign(n.xy); n = normalize(n);
+//
+
+#ifndef vertex_format_h
+#define vertex_format_h
+
+#include <glad/glad.h>
+#include "glm.hpp"
+
+#include <string>
+#include <sstream>
+
+// attributes of the vertex which can be sent to the GPU (the position is always sent)
+const unsigned int VERTEX_NORMAL = 1 << 0;
+const unsigned int VERTEX_TEX_COORDS = 1 << 1;
+const unsigned int VERTEX_TANGENT = 1 << 2;
+const unsigned int VERTEX_BITANGENT = 1 << 3;
+const unsigned int VERTEX_ALL = VERTEX_NORMAL | VERTEX_TEX_COORDS | VERTEX_TANGENT | VERTEX_BITANGENT;
+
+struct VertexFormat {
+    unsigned int attributes = VERTEX_ALL;
+    bool half_tex_coords = false; // 2 x 16-bit float instead of 2 x 32-bit float
+    bool octahedral_normals = false; // 2 x 16-bit snorm instead of 3 x 32-bit float
+
+    // offsets of the attributes in the vertex in bytes, -1 if the attribute is not sent
+    struct Layout {
+        int normal = -1, tex_coords = -1, tangent = -1, bitangent = -1;
+        unsigned int stride = 0;
+    };
+
+    Layout layout() const {
+        Layout l;
+        unsigned int offset = 3 * sizeof(float);
+        if(attributes & VERTEX_NORMAL) {
+            l.normal = (int)offset;
+            offset += octahedral_normals ? 2 * sizeof(short) : 3 * sizeof(float);
+        }
+        if(attributes & VERTEX_TEX_COORDS) {
+            l.tex_coords = (int)offset;
+            offset += half_tex_coords ? 2 * sizeof(short) : 2 * sizeof(float);
+        }
+        if(attributes & VERTEX_TANGENT) {
+            l.tangent = (int)offset;
+            offset += 3 * sizeof(float);
+        }
+        if(attributes & VERTEX_BITANGENT) {
+            l.bitangent = (int)offset;
+            offset += 3 * sizeof(float);
+        }
+        l.stride = offset;
+        return l;
+    }
+
+    // the tangents are calculated by Assimp only if they are used
+    inline bool needsTangents() const {
+        return (attributes & (VERTEX_TANGENT | VERTEX_BITANGENT)) != 0;
+    }
+
+    // different formats have different codes
+    inline unsigned int code() const {
+        return attributes | (half_tex_coords ? 1 << 4 : 0) | (octahedral_normals ? 1 << 5 : 0);
+    }
+
+    inline bool operator==(const VertexFormat& other) const {
+        return code() == other.code();
+    }
+
+    // point the attributes of the bound vertex array to the bound vertex buffer
+    void setAttributePointers() const {
+        Layout l = layout();
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, l.stride, (void*)0);
+        if(l.normal >= 0) {
+            glEnableVertexAttribArray(1);
+            if(octahedral_normals) glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, l.stride, (void*)(size_t)l.normal);
+            else glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, l.stride, (void*)(size_t)l.normal);
+        }
+        if(l.tex_coords >= 0) {
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, half_tex_coords ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, l.stride, (void*)(size_t)l.tex_coords);
+        }
+        if(l.tangent >= 0) {
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, l.stride, (void*)(size_t)l.tangent);
+        }
+        if(l.bitangent >= 0) {
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, l.stride, (void*)(size_t)l.bitangent);
+        }
+    }
+
+    // octahedral mapping of a unit vector to [-1, 1]^2
+    static glm::vec2 octahedralEncode(const glm::vec3& n) {
+        float length = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+        if(length == 0.0f) return glm::vec2(0.0f);
+        glm::vec3 v = n / length;
+        glm::vec2 e(v.x, v.y);
+        if(v.z < 0.0f) {
+            e.x = (1.0f - glm::abs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f);
+            e.y = (1.0f - glm::abs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return e;
+    }
+
+    static VertexFormat fromSource(const std::string& vertex_code, bool half_tex_coords) {
+        VertexFormat format;
+        format.attributes = 0;
+        format.half_tex_coords = half_tex_coords;
+
+        std::stringstream code(vertex_code);
+        std::string code_line;
+        while(std::getline(code, code_line)) {
+            size_t layout = code_line.find("layout");
+            if(layout == std::string::npos || code_line.find("location", layout) == std::string::npos) continue;
+            size_t comment = code_line.find("//");
+            if(comment != std::string::npos && comment < layout) continue;
+            size_t closing = code_line.find(')', layout);
+            if(closing == std::string::npos) continue;
+
+            // after the layout qualifier: "in", the type and the name
+            std::stringstream declaration(code_line.substr(closing + 1));
+            std::string qualifier, type, attribute;
+            declaration >> qualifier >> type >> attribute;
+            if(qualifier != "in") continue;
+            attribute = attribute.substr(0, attribute.find(';'));
+            if(attribute == "aNormal") {
+                format.attributes |= VERTEX_NORMAL;
+                format.octahedral_normals = type == "vec2";
+            } else if(attribute == "aTexCoords") format.attributes |= VERTEX_TEX_COORDS;
+            else if(attribute == "aTangent") format.attributes |= VERTEX_TANGENT;
+            else if(attribute == "aBitangent") format.attributes |= VERTEX_BITANGENT;
+        }
+        return format;
+    }
+};
+
+#endif /* vertex_format_h */
@@ -0,0 +1,120 @@
+//
+//  warm_start.h
+//  Special Relativity
+//
+//  Keeps the local times (t_c') solved for every vertex of one object, so the next frame can start the search next to them. Between two frames the times move only by about the time step, so the solver needs just a few iterations instead of searching the whole "time_bracket".
+//  Every mesh of the model gets two buffers (vec2 per vertex: local time, number of iterations) - one is read as the attribute 5 of the mesh and the other one is written with transform feedback, then they are swapped.
+//
+//  *** "solve(model)":
+//  - runs the WARM_START variant of "sr_ray.vs" over the vertices of the model (as points, without rasterization) and captures the solved local times.
+//
+//  *** "draw(model, shader)":
+//  - draws the model with the SOLVED_TIME variant of "sr_ray.vs", which reads the local times captured by "solve".
+//
+//  The transform feedback records the vertices in the order of the primitives, so the solving pass draws the vertex buffer as points - every vertex is solved exactly once and the result lands at its own index.
+//
+
+#ifndef warm_start_h
+#define warm_start_h
+
+#include <glad/glad.h>
+
+#include "model.h"
+#include "shader.h"
+#include "gl_state.h"
+
+#include <vector>
+
+class WarmStart {
+private:
+    std::vector<unsigned int> buffers[2];
+    unsigned int current = 0; // buffer with the latest local times
+
+    bool valid = false;
+
+    void bindSolvedTime(const Mesh& mesh, unsigned int buffer) const {
+        GLState::bindVertexArray(mesh.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    }
+
+    void release() {
+        for(unsigned int i = 0; i < 2; i++) {
+            if(!buffers[i].empty()) glDeleteBuffers((GLsizei)buffers[i].size(), buffers[i].data());
+            buffers[i].clear();
+        }
+    }
+
+public:
+    WarmStart(const Model& model) {
+        for(unsigned int i = 0; i < 2; i++) {
+            buffers[i].resize(model.meshes.size());
+            glGenBuffers((GLsizei)buffers[i].size(), buffers[i].data());
+            for(unsigned int j = 0; j < model.meshes.size(); j++) {
+                std::vector<float> zeros(2 * model.meshes[j].vertex_count, 0.0f);
+                glBindBuffer(GL_ARRAY_BUFFER, buffers[i][j]);
+                glBufferData(GL_ARRAY_BUFFER, zeros.size() * sizeof(float), zeros.data(), GL_DYNAMIC_COPY);
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // the buffers belong to the OpenGL context, so the object can only be moved
+    WarmStart(const WarmStart&) = delete;
+    WarmStart& operator=(const WarmStart&) = delete;
+
+    WarmStart(WarmStart&& other) noexcept : current(other.current), valid(other.valid) {
+        for(unsigned int i = 0; i < 2; i++) buffers[i].swap(other.buffers[i]);
+    }
+
+    WarmStart& operator=(WarmStart&& other) noexcept {
+        if(this != &other) {
+            release();
+            for(unsigned int i = 0; i < 2; i++) buffers[i].swap(other.buffers[i]);
+            current = other.current;
+            valid = other.valid;
+        }
+        return *this;
+    }
+
+    ~WarmStart() {
+        release();
+    }
+
+    // false if the stored times cannot be used as a starting point (not solved yet or the scene has jumped)
+    inline bool isValid() const {
+        return valid;
+    }
+
+    inline void invalidate() {
+        valid = false;
+    }
+
+    // the WARM_START shader has to be in use, with all the uniforms set and GL_RASTERIZER_DISCARD enabled
+    void solve(const Model& model) {
+        unsigned int next = 1 - current;
+        for(unsigned int i = 0; i < model.meshes.size(); i++) {
+            const Mesh& mesh = model.meshes[i];
+            bindSolvedTime(mesh, buffers[current][i]);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[next][i]);
+
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, 0, (GLsizei)mesh.vertex_count);
+            glEndTransformFeedback();
+        }
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+        current = next;
+        valid = true;
+    }
+
+    void draw(Model& model, const Shader& shader) const {
+        for(unsigned int i = 0; i < model.meshes.size(); i++) {
+            bindSolvedTime(model.meshes[i], buffers[current][i]);
+            model.meshes[i].draw(shader);
+        }
+    }
+};
+
+#endif /* warm_start_h */